@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Implementation of the bump allocator used by the Parallel Bucket Sort.
+ */
+
+#include <cstdint>
+#include <algorithm>
+#include "Arena.h"
+
+//allocations are rounded up to whole cache lines
+constexpr std::size_t alignment = 64;
+
+void* Arena::allocateBytes(std::size_t bytes) {
+	bytes = (bytes + alignment - 1) / alignment * alignment;
+
+	//start a bigger block if this one is full
+	//the old block may still be in use, so it is kept until the scope that
+	//was using it ends
+	if (_used + bytes > _capacity) {
+		if (_storage) {
+			_retired.push_back(std::move(_storage));
+		}
+		_capacity = std::max(bytes, 2 * _capacity);
+		_storage.reset(new char[_capacity + alignment]);
+		const auto address = reinterpret_cast<std::uintptr_t>(_storage.get());
+		_block = _storage.get() + (alignment - address % alignment) % alignment;
+		_used = 0;
+	}
+
+	void* p = _block + _used;
+	_used += bytes;
+	return p;
+}
+
+Arena::Scope::~Scope() {
+	--_arena._scopes;
+	if (_arena._storage.get() == _storage) {
+		_arena._used = _used;
+	} else {
+		//the arena grew during this scope, so everything in the current block
+		//was allocated within it, as was everything in the blocks retired
+		//since the scope started; the block the scope started in was the
+		//first of those, and still holds the memory of outer scopes unless
+		//it was empty (scopes nest, so outer scopes only use older blocks)
+		auto& retired = _arena._retired;
+		const std::size_t keep = _retired + ((_storage && _used > 0) ? 1 : 0);
+		retired.erase(retired.begin() + keep, retired.end());
+		_arena._used = 0;
+	}
+
+	//once nothing is in use, a block grown past the limit is freed, so the
+	//next sort starts with a smaller one
+	if (_arena._scopes == 0 && _arena._used == 0 && _arena._capacity > retainedBytes) {
+		_arena._retired.clear();
+		_arena._storage.reset();
+		_arena._block = nullptr;
+		_arena._capacity = 0;
+	}
+}
+
+Arena& threadArena() {
+	thread_local Arena arena;
+	return arena;
+}
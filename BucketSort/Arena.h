@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Interface for the bump allocator used by the Parallel Bucket Sort.
+ *
+ * Each thread has its own arena, so the recursion of doSort can take its
+ * temporary buffers without locking or calling malloc. Memory is handed out
+ * by bumping a pointer and given back in reverse order with a Scope. When
+ * the outermost scope ends, the arena keeps its block for the next sort
+ * unless the block is larger than retainedBytes, so once it has grown to fit
+ * the buckets a thread sorts, later sorts allocate nothing, while a thread
+ * that once sorted a huge bucket does not hold on to its memory.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+class Arena {
+public:
+	Arena() = default;
+	Arena(const Arena& a) = delete;
+	Arena& operator=(const Arena& a) = delete;
+
+	//space for n objects of type T, which must not need destroying
+	//the space is uninitialised and 64-byte aligned
+	template <typename T> T* allocate(std::size_t n) {
+		return static_cast<T*>(allocateBytes(n * sizeof(T)));
+	}
+
+	//the largest block kept once every scope has ended
+	static constexpr std::size_t retainedBytes = std::size_t(16) << 20;
+
+	//gives back everything allocated from the arena during its lifetime
+	class Scope {
+	public:
+		explicit Scope(Arena& arena) : _arena{arena}, _storage{arena._storage.get()},
+		_used{arena._used}, _retired{arena._retired.size()} {
+			++arena._scopes;
+		}
+		~Scope();
+		Scope(const Scope& s) = delete;
+		Scope& operator=(const Scope& s) = delete;
+	private:
+		Arena& _arena;
+		const char* _storage; //the block in use when the scope started
+		std::size_t _used; //how much of it was in use
+		std::size_t _retired; //how many blocks had been retired
+	};
+private:
+	void* allocateBytes(std::size_t bytes);
+
+	std::unique_ptr<char[]> _storage; //the current block, before alignment
+	char* _block{nullptr}; //the current block, aligned
+	std::size_t _capacity{0}; //bytes in the current block
+	std::size_t _used{0}; //bytes of the current block in use
+	std::vector<std::unique_ptr<char[]>> _retired; //outgrown blocks, oldest first
+	unsigned int _scopes{0}; //scopes that have not ended
+};
+
+//the arena of the calling thread
+Arena& threadArena();
+
+#endif
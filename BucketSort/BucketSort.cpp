@@ -6,187 +6,1294 @@
  * algorithm.
  */
 
-#include <cmath>
-#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <limits>
 #include <thread>
+#include <memory>
 #include <vector>
-#include <string>
+#include <utility>
 #include <iostream>
 #include <algorithm>
+#include <stdexcept>
+#include <system_error>
 #include "BucketSort.h"
+#include "Arena.h"
+#include "Digits.h"
+#include "DivideWork.h"
+#include "ScatterBuffers.h"
+#include "SortStats.h"
+#include "ThreadPool.h"
 
-//compares two unsigned integers lexicographically
-bool aLessB(const unsigned int& x, const unsigned int& y, unsigned int pow) {
-	//if x and y are the same, then one is not less than the other
-	if (x == y) return false;
+//sort the vector using a single-threaded sorting algorithm
+//each number is turned into its lexicographic key once, so sorting only
+//needs integer comparisons, and the keys are turned back into numbers after
+void BucketSort::simpleSort() {
+	std::vector<unsigned long long> keys(numbersToSort.size());
+	std::transform(numbersToSort.begin(), numbersToSort.end(), keys.begin(), lexKey);
+	std::sort(keys.begin(), keys.end());
+	std::transform(keys.begin(), keys.end(), numbersToSort.begin(), fromLexKey);
+}
+
+//sort [first, last) lexicographically using insertion sort
+//used for small buckets, where splitting into 11 more buckets costs more
+void insertionSort(unsigned int* first, unsigned int* last) {
+	if (last - first < 2) return;
+	for (auto it = first + 1; it != last; ++it) {
+		const unsigned int n = *it;
+		auto hole = it;
+		for (; hole != first && lexLess(n, *(hole - 1)); --hole) {
+			*hole = *(hole - 1);
+		}
+		*hole = n;
+	}
+}
+
+//check if [first, last) is in lexicographic order
+//each number's key is only worked out once, rather than twice per comparison
+bool isLexSorted(const unsigned int* first, const unsigned int* last) {
+	if (first == last) return true;
+	unsigned long long previous = lexKey(*first);
+	for (++first; first != last; ++first) {
+		const unsigned long long key = lexKey(*first);
+		if (key < previous) return false;
+		previous = key;
+	}
+	return true;
+}
 
-	unsigned int a = x;
-	unsigned int b = y;
+//sort numbers in numeric order with an LSD radix sort on 11-bit digits
+//each pass is split between numCores - 1 threads, which each count their
+//part of the vector, then scatter it into a single ping-pong buffer
+void numericSort(std::vector<unsigned int>& numbers, unsigned int numCores,
+std::shared_ptr<ThreadPool>& pool) {
+	const unsigned int digitBits = 11;
+	const unsigned int radix = 1U << digitBits;
+	const unsigned int numPasses = 3; //11 + 11 + 10 bits
 
-	//work out the digit currently being compared
-	if (pow == 0) {
-		while (a / 10 > 0) {
-			a = a / 10;
+	//run a task for each part, in parallel if there are extra threads
+	const unsigned int numParts = (numCores == 1) ? 1 : numCores - 1;
+	ThreadPool* workers = (numCores == 1) ? nullptr : &poolFor(pool, numParts);
+	auto runParts = [workers, numParts] (const auto& task) {
+		if (!workers) {
+			task(0);
+			return;
 		}
-		while (b / 10 > 0) {
-			b = b / 10;
+		TaskGroup group;
+		for (unsigned int t = 0; t < numParts; ++t) {
+			workers->submit(group, [&task, t] () { task(t); });
 		}
-	} else {
-		while (a / 10 >= static_cast<unsigned int>(std::round(std::pow(10, pow)))) {
-			a = a / 10;
+		workers->wait(group);
+	};
+
+	std::vector<unsigned int> buffer(numbers.size());
+	unsigned int* src = numbers.data();
+	unsigned int* dst = buffer.data();
+	const std::size_t size = numbers.size();
+	std::vector<std::vector<std::size_t>> counts(numParts, std::vector<std::size_t>(radix));
+
+	for (unsigned int pass = 0; pass < numPasses; ++pass) {
+		const unsigned int shift = pass * digitBits;
+
+		//each thread counts the digits in its part
+		runParts([src, size, shift, numParts, &counts] (unsigned int t) {
+			auto& histogram = counts[t];
+			std::fill(histogram.begin(), histogram.end(), 0);
+			const auto end = src + size * (t + 1) / numParts;
+			for (auto it = src + size * t / numParts; it != end; ++it) {
+				++histogram[(*it >> shift) & (radix - 1)];
+			}
+		});
+
+		//prefix sum digit by digit, then thread by thread, so the scatter
+		//is stable and each thread writes to its own region of each digit
+		std::size_t offset = 0;
+		bool allSame = false;
+		for (unsigned int d = 0; d < radix; ++d) {
+			std::size_t total = 0;
+			for (unsigned int t = 0; t < numParts; ++t) {
+				const std::size_t count = counts[t][d];
+				counts[t][d] = offset;
+				offset += count;
+				total += count;
+			}
+			allSame = allSame || total == size;
 		}
-		while (b / 10 >= static_cast<unsigned int>(std::round(std::pow(10, pow)))) {
-			b = b / 10;
+
+		//skip the pass if every number has the same digit
+		if (allSame) continue;
+
+		//each thread moves its numbers into place in the other buffer
+		runParts([src, dst, size, shift, numParts, &counts] (unsigned int t) {
+			auto& next = counts[t];
+			const auto end = src + size * (t + 1) / numParts;
+			for (auto it = src + size * t / numParts; it != end; ++it) {
+				dst[next[(*it >> shift) & (radix - 1)]++] = *it;
+			}
+		});
+		std::swap(src, dst);
+	}
+
+	//the sorted numbers may have ended up in the buffer
+	if (src != numbers.data()) {
+		numbers.swap(buffer);
+	}
+}
+
+//what the tasks of one sort share: the flag that cancels it and, when
+//compiled with BUCKETSORT_STATS, the counters its SortStats come from
+struct SortContext {
+	const std::atomic<bool>* cancelled = nullptr;
+	BucketSort::Scatter scatter = BucketSort::Scatter::Direct;
+	unsigned int numThreads = 0; //workers in the pool when the sort started
+	std::unique_ptr<std::atomic<std::size_t>[]> numbersPerThread; //numThreads + 1
+	std::atomic<std::size_t> rangesAtDigit[11]{};
+	std::atomic<std::size_t> bucketsOfSize[48]{};
+};
+
+//whether the sort has been cancelled
+static bool isCancelled(const SortContext* context) {
+	return context && context->cancelled && *context->cancelled;
+}
+
+//count a range of the sort reaching digit k
+static void countRange(SortContext* context, unsigned int k) {
+	if (statsEnabled && context) {
+		++context->rangesAtDigit[std::min(k, 10U)];
+	}
+}
+
+//count a bucket of size numbers being split off
+static void countBucket(SortContext* context, std::size_t size) {
+	if (statsEnabled && context && size > 0) {
+		unsigned int log2 = 0;
+		while (size >>= 1) ++log2;
+		++context->bucketsOfSize[std::min(log2, 47U)];
+	}
+}
+
+//count size numbers being moved into buckets by the calling thread
+static void countMoved(SortContext* context, const ThreadPool* workers, std::size_t size) {
+	if (statsEnabled && context) {
+		const unsigned int self = workers ? workers->currentIndex() : context->numThreads;
+		context->numbersPerThread[std::min(self, context->numThreads)] += size;
+	}
+}
+
+//ranges with at least this many numbers are scattered through write
+//combining buffers, if the sort asks for them; smaller ones fit in the cache
+constexpr std::size_t bufferedScatterSize = 1 << 16;
+
+//whether to scatter size numbers through ScatterBuffers, and if so whether
+//to write their lines with non-temporal stores
+static bool useBuffers(const SortContext* context, std::size_t size, bool& nonTemporal) {
+	const auto scatter = context ? context->scatter : BucketSort::Scatter::Direct;
+	nonTemporal = scatter == BucketSort::Scatter::NonTemporal;
+	return scatter != BucketSort::Scatter::Direct && size >= bufferedScatterSize;
+}
+
+//move the size numbers from first into their buckets in dst, where
+//buckets[i] is the bucket of first[i] and next[b] is where bucket b starts
+static void scatterRange(const unsigned int* first, std::size_t size,
+const unsigned char* buckets, unsigned int* dst, std::size_t* next,
+unsigned int numBuckets, const SortContext* context) {
+	bool nonTemporal;
+	if (!useBuffers(context, size, nonTemporal)) {
+		for (std::size_t i = 0; i < size; ++i) {
+			dst[next[buckets[i]]++] = first[i];
 		}
+		return;
+	}
+	Arena& arena = threadArena();
+	Arena::Scope scope(arena);
+	ScatterBuffers out(dst, next, numBuckets,
+		arena.allocate<unsigned int>(numBuckets * ScatterBuffers::lineSize),
+		arena.allocate<unsigned int>(numBuckets), nonTemporal);
+	for (std::size_t i = 0; i < size; ++i) {
+		out.push(first[i], buckets[i]);
 	}
+	out.finish();
+}
 
-	if (a == b) {
-		return aLessB(x, y, pow + 1); //recurse if this digit is the same
-	} else {
-		return a < b; //otherwise, compare the digits
+//a number that makes up most of [first, first + size), found by
+//sampling, or false if no number is that common
+//samples are evenly spaced, so runs of equal numbers are found too
+static bool findHeavy(const unsigned int* first, std::size_t size, unsigned int& heavy) {
+	const unsigned int numSamples = 16;
+	const unsigned int heavyShare = 12; //three quarters of the samples
+	unsigned int samples[numSamples];
+	for (unsigned int i = 0; i < numSamples; ++i) {
+		samples[i] = first[size * i / numSamples];
+	}
+	for (unsigned int i = 0; i + heavyShare <= numSamples; ++i) {
+		if (std::count(samples + i, samples + numSamples, samples[i]) >= heavyShare) {
+			heavy = samples[i];
+			return true;
+		}
 	}
+	return false;
 }
 
-//sort the vector using a single-threaded sorting algorithm
-void BucketSort::simpleSort() {
-	std::sort(numbersToSort.begin(), numbersToSort.end(),
-	[] (const auto& x, const auto& y) {
-		return aLessB(x, y, 0);
-	});
+//partition [first, last) into the numbers before pivot, the copies of pivot
+//and the numbers after it, returning where the copies start and end
+//the copies are only counted, then written out at the end, so they are
+//never moved; the numbers after pivot go through scratch
+static std::pair<unsigned int*, unsigned int*> partitionAround(unsigned int* first,
+unsigned int* last, unsigned int pivot, unsigned int* scratch) {
+	const unsigned long long pivotKey = lexKey(pivot);
+	unsigned int* before = first;
+	unsigned int* after = scratch;
+	for (unsigned int* it = first; it != last; ++it) {
+		if (*it == pivot) continue;
+		const unsigned long long key = lexKey(*it);
+		if (key < pivotKey) {
+			*before++ = *it;
+		} else if (key > pivotKey) {
+			*after++ = *it;
+		}
+	}
+	unsigned int* copiesEnd = last - (after - scratch);
+	std::fill(before, copiesEnd, pivot);
+	std::copy(scratch, after, copiesEnd);
+	return {before, copiesEnd};
+}
+
+//ranges with at least this many numbers are checked for heavy duplicates
+constexpr std::size_t duplicateCheckSize = 1024;
+
+//sort [first, last) based on the k-th most significant digit onwards
+//the numbers are classified and scattered through buffers taken from the
+//thread's arena, which are given back before recursing, so the recursion
+//does not allocate; with workers, large buckets are sorted as tasks so that
+//idle threads can steal them, which keeps every thread busy even if most
+//numbers share the same leading digits
+static void sortRange(unsigned int* first, unsigned int* last, unsigned int k,
+unsigned int cutoff, ThreadPool* workers, SortContext* context = nullptr) {
+	const std::size_t size = last - first;
+
+	//a cancelled sort leaves the rest of the numbers where they are
+	if (isCancelled(context)) {
+		return;
+	}
+	countRange(context, k);
+
+	//insertion sort small buckets rather than splitting them up further
+	if (size < cutoff) {
+		insertionSort(first, last);
+		return;
+	}
+
+	//if less than 2 items or already sorted, return straight away
+	if (size < 2 || isLexSorted(first, last)) {
+		return;
+	}
+
+	//a number with many copies is split off by a three-way partition, so
+	//the copies are dealt with once rather than at every remaining digit;
+	//the numbers either side of it still share their first k digits
+	unsigned int heavy;
+	if (size >= duplicateCheckSize && findHeavy(first, size, heavy)) {
+		std::pair<unsigned int*, unsigned int*> copies;
+		{
+			Arena& arena = threadArena();
+			Arena::Scope scope(arena);
+			copies = partitionAround(first, last, heavy, arena.allocate<unsigned int>(size));
+		}
+		countMoved(context, workers, size);
+		countBucket(context, copies.first - first);
+		countBucket(context, copies.second - copies.first);
+		countBucket(context, last - copies.second);
+		TaskGroup group;
+		const bool spawn = workers &&
+			static_cast<std::size_t>(copies.first - first) >= parallelGrain;
+		if (spawn) {
+			workers->submit(group, [first, copies, k, cutoff, workers, context] () {
+				sortRange(first, copies.first, k, cutoff, workers, context);
+			});
+		} else {
+			sortRange(first, copies.first, k, cutoff, workers, context);
+		}
+		sortRange(copies.second, last, k, cutoff, workers, context);
+		if (spawn) {
+			workers->wait(group);
+		}
+		return;
+	}
+
+	//each bucket corresponds to a possible k-th msd
+	//the first bucket stores numbers with k-th msd equal to -1 (padding)
+	const unsigned int numBuckets = 11;
+	std::size_t starts[numBuckets + 1] = {};
+	bool sameDigit = false;
+	{
+		Arena& arena = threadArena();
+		Arena::Scope scope(arena);
+
+		//classify every number once, counting the size of each bucket
+		unsigned char* buckets = arena.allocate<unsigned char>(size);
+		bucketsOf(first, size, k, buckets);
+		for (std::size_t i = 0; i < size; ++i) {
+			++starts[buckets[i] + 1];
+		}
+
+		//numbers in the padding bucket have exactly k digits, so are equal
+		if (starts[1] == size) {
+			return;
+		}
+
+		//if every number has the same digit, nothing needs to move
+		sameDigit = std::find(starts + 2, starts + numBuckets + 1, size) != starts + numBuckets + 1;
+		if (!sameDigit) {
+			for (unsigned int b = 0; b < numBuckets; ++b) {
+				starts[b + 1] += starts[b];
+			}
+
+			//place each number in its bucket, then copy them back in order
+			unsigned int* scratch = arena.allocate<unsigned int>(size);
+			std::size_t next[numBuckets];
+			std::copy(starts, starts + numBuckets, next);
+			scatterRange(first, size, buckets, scratch, next, numBuckets, context);
+			std::copy(scratch, scratch + size, first);
+			countMoved(context, workers, size);
+			for (unsigned int b = 0; b < numBuckets; ++b) {
+				countBucket(context, starts[b + 1] - starts[b]);
+			}
+		}
+	}
+
+	const unsigned int nextDigit = k + 1; //i.e. shift to next msd
+	if (sameDigit) {
+		sortRange(first, last, nextDigit, cutoff, workers, context);
+		return;
+	}
+
+	//sort each bucket recursively, apart from the padding bucket
+	TaskGroup group;
+	bool spawned[numBuckets] = {};
+	for (unsigned int b = 1; b < numBuckets; ++b) {
+		if (workers && starts[b + 1] - starts[b] >= parallelGrain) {
+			spawned[b] = true;
+			unsigned int* bucketFirst = first + starts[b];
+			unsigned int* bucketLast = first + starts[b + 1];
+			workers->submit(group, [bucketFirst, bucketLast, nextDigit, cutoff, workers, context] () {
+				sortRange(bucketFirst, bucketLast, nextDigit, cutoff, workers, context);
+			});
+		}
+	}
+	for (unsigned int b = 1; b < numBuckets; ++b) {
+		if (!spawned[b] && starts[b + 1] - starts[b] > 1) {
+			sortRange(first + starts[b], first + starts[b + 1], nextDigit, cutoff, workers, context);
+		}
+	}
+	if (workers) {
+		workers->wait(group);
+	}
 }
 
-//divide a vector into components of work based on the number of cores n
-//credit to Matthew Stark (COMP6771 Lecturer, 2017)
-/* BEGIN VERBATIM FROM MATTHEW STARK */
-template <typename It>
-std::vector<std::pair<It, It>> divideWork(It begin, It end, unsigned n) {
-	auto dis = std::distance(begin, end);
-	auto npercore = (dis / n) + 1;
-	auto extras = dis % n;
-	std::vector<std::pair<It, It>> result;
-	for (auto i = 0U; i < n; ++i) {
-		if (i == extras)
-			--npercore;
-		result.emplace_back(begin, begin + npercore);
-		begin += npercore;
+//merge the sorted ranges [a, aLast) and [b, bLast) into out
+//the key of the front of each range is kept rather than worked out again
+static unsigned int* mergeRuns(const unsigned int* a, const unsigned int* aLast,
+const unsigned int* b, const unsigned int* bLast, unsigned int* out) {
+	if (a != aLast && b != bLast) {
+		unsigned long long keyA = lexKey(*a);
+		unsigned long long keyB = lexKey(*b);
+		while (true) {
+			if (keyB < keyA) {
+				*out++ = *b++;
+				if (b == bLast) break;
+				keyB = lexKey(*b);
+			} else {
+				*out++ = *a++;
+				if (a == aLast) break;
+				keyA = lexKey(*a);
+			}
+		}
+	}
+	out = std::copy(a, aLast, out);
+	return std::copy(b, bLast, out);
+}
+
+//the most runs a range can be split into and still be merged rather than
+//sorted with buckets
+const unsigned int maxRuns = 64;
+
+//sort [first, last) if it is made up of at most maxRuns sorted runs
+//(such as numbers that increase numerically, which are sorted within each
+//length) by merging neighbouring runs until one is left
+static bool mergeSortedRuns(unsigned int* first, unsigned int* last) {
+	const std::size_t size = last - first;
+
+	//find where each run starts, giving up as soon as there are too many
+	std::size_t starts[maxRuns + 1];
+	unsigned int numRuns = 1;
+	starts[0] = 0;
+	unsigned long long previous = lexKey(*first);
+	for (std::size_t i = 1; i < size; ++i) {
+		const unsigned long long key = lexKey(first[i]);
+		if (key < previous) {
+			if (numRuns == maxRuns) return false;
+			starts[numRuns++] = i;
+		}
+		previous = key;
 	}
+	starts[numRuns] = size;
+
+	//a single run is sorted already, so needs no buffer
+	if (numRuns == 1) {
+		return true;
+	}
+
+	//merge pairs of runs back and forth between the range and a buffer
+	Arena& arena = threadArena();
+	Arena::Scope scope(arena);
+	unsigned int* buffer = arena.allocate<unsigned int>(size);
+	unsigned int* from = first;
+	unsigned int* to = buffer;
+	while (numRuns > 1) {
+		unsigned int merged = 0;
+		for (unsigned int r = 0; r < numRuns; r += 2) {
+			const std::size_t middle = starts[std::min(r + 1, numRuns)];
+			const std::size_t end = starts[std::min(r + 2, numRuns)];
+			mergeRuns(from + starts[r], from + middle, from + middle, from + end,
+				to + starts[r]);
+			starts[merged++] = starts[r];
+		}
+		starts[merged] = size;
+		numRuns = merged;
+		std::swap(from, to);
+	}
+	if (from != first) {
+		std::copy(from, from + size, first);
+	}
+	return true;
+}
+
+//sort [first, last) if it is sorted apart from a few numbers out of place
+//(like an append-mostly log) by taking out the numbers that break the
+//order, sorting those and merging them back in
+//gives up, leaving the numbers in some order, if more than 1 in 16 are out
+//of place; this is usually found within the first few thousand numbers
+static bool mergeOutliers(unsigned int* first, unsigned int* last, unsigned int cutoff,
+ThreadPool* workers, SortContext* context) {
+	const std::size_t size = last - first;
+	const std::size_t minScanned = 4096;
+	Arena& arena = threadArena();
+	Arena::Scope scope(arena);
+	unsigned int* outliers = arena.allocate<unsigned int>(size / 16 + minScanned);
+
+	//keep a sorted sequence at the front of the range
+	//a number that does not fit after the last kept one may fit in place of
+	//the last few, in which case they (likely large outliers) are moved out
+	const std::size_t maxReplaced = 8;
+	std::size_t kept = 0, numOutliers = 0;
+	unsigned long long lastKey = 0;
+	for (std::size_t i = 0; i < size; ++i) {
+		const unsigned int n = first[i];
+		const unsigned long long key = lexKey(n);
+		if (kept == 0 || key >= lastKey) {
+			first[kept++] = n;
+			lastKey = key;
+			continue;
+		}
+
+		std::size_t place = kept - 1;
+		while (kept - place < maxReplaced && place > 0 && key < lexKey(first[place - 1])) {
+			--place;
+		}
+		if (place == 0 || key >= lexKey(first[place - 1])) {
+			numOutliers = std::copy(first + place, first + kept, outliers + numOutliers) - outliers;
+			first[place] = n;
+			kept = place + 1;
+			lastKey = key;
+		} else {
+			outliers[numOutliers++] = n;
+		}
+
+		//put the outliers back in the gap they left if there are too many
+		if (numOutliers * 16 > std::max(i + 1, minScanned)) {
+			std::copy(outliers, outliers + numOutliers, first + kept);
+			return false;
+		}
+	}
+
+	//sort the outliers, then merge them in from the back of the range
+	//(if the sort is cancelled, the merge still puts every number back)
+	sortRange(outliers, outliers + numOutliers, 0, cutoff, workers, context);
+	unsigned int* out = last;
+	const unsigned int* a = first + kept;
+	unsigned int* b = outliers + numOutliers;
+	while (a != first && b != outliers) {
+		if (lexKey(*(b - 1)) < lexKey(*(a - 1))) {
+			*--out = *--a;
+		} else {
+			*--out = *--b;
+		}
+	}
+	std::copy(outliers, b, first);
+	return true;
+}
+
+//sort [first, last) in close to linear time if it is nearly sorted already
+//returns false, leaving the numbers in some order, if it is not
+static bool sortPresorted(unsigned int* first, unsigned int* last, unsigned int cutoff,
+ThreadPool* workers, SortContext* context = nullptr) {
+	if (static_cast<std::size_t>(last - first) < cutoff || last - first < 2) {
+		return false;
+	}
+	return mergeSortedRuns(first, last) || mergeOutliers(first, last, cutoff, workers, context);
+}
+
+//the measured costs that coresFor chooses the number of cores from
+struct Calibration {
+	double nanosPerNumber; //sorting one number on one thread
+	double nanosPerThread; //handing a task to another thread and waiting for it
+	unsigned int hardwareCores; //the most cores worth using
+};
+
+//measure the costs once, the first time they are needed
+//each is the fastest of a few tries, so a busy moment does not skew it
+static const Calibration& calibration() {
+	static const Calibration measured = [] () {
+		using Clock = std::chrono::steady_clock;
+		auto nanos = [] (Clock::duration d) {
+			return std::chrono::duration<double, std::nano>(d).count();
+		};
+		const unsigned int tries = 3;
+
+		//sort numbers of every length on this thread
+		const std::size_t sampleSize = 1 << 16;
+		std::vector<unsigned int> sample(sampleSize), copy(sampleSize);
+		unsigned int n = 1;
+		for (auto& number: sample) {
+			n = n * 1664525 + 1013904223;
+			number = n >> (n % 32);
+		}
+		Calibration c{std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+			std::max(1U, std::thread::hardware_concurrency())};
+		for (unsigned int i = 0; i < tries; ++i) {
+			copy = sample;
+			Arena::Scope scope(threadArena());
+			const auto start = Clock::now();
+			sortRange(copy.data(), copy.data() + copy.size(), 0, BucketSort().cutoff, nullptr);
+			c.nanosPerNumber = std::min(c.nanosPerNumber, nanos(Clock::now() - start) / sampleSize);
+		}
+
+		//run empty tasks on another thread, one at a time
+		const unsigned int roundTrips = 32;
+		ThreadPool workers(1);
+		for (unsigned int i = 0; i < tries; ++i) {
+			const auto start = Clock::now();
+			for (unsigned int j = 0; j < roundTrips; ++j) {
+				TaskGroup group;
+				workers.submit(group, [] () {});
+				workers.wait(group);
+			}
+			c.nanosPerThread = std::min(c.nanosPerThread, nanos(Clock::now() - start) / roundTrips);
+		}
+		return c;
+	}();
+	return measured;
+}
+
+//choose the number of cores for size numbers: another core is added while
+//the time it saves the others is more than it costs to hand it work, and
+//each core needs at least a task's worth of numbers
+unsigned int BucketSort::coresFor(std::size_t size) {
+	const Calibration& c = calibration();
+	const double work = size * c.nanosPerNumber;
+	const unsigned int maxCores = static_cast<unsigned int>(std::min<std::size_t>(
+		c.hardwareCores, std::max<std::size_t>(1, size / parallelGrain)));
+	unsigned int cores = 1;
+	while (cores < maxCores && work / cores - work / (cores + 1) > c.nanosPerThread) {
+		++cores;
+	}
+	return cores;
+}
+
+//sort the vector using numCores - 1 threads from the pool
+SortStats BucketSort::sort(unsigned int numCores, Order order) {
+	return sortUntil(numCores, order, nullptr);
+}
+
+//sort the vector on the pool, returning a future for the result
+//the sort is driven by a pool task of its own, which (like any thread that
+//waits) runs the sort's other tasks while it waits for them
+std::future<void> BucketSort::sortAsync(unsigned int numCores, Order order) {
+	auto cancelled = std::make_shared<std::atomic<bool>>(false);
+	_cancelled = cancelled;
+	auto done = std::make_shared<std::promise<void>>();
+	std::future<void> result = done->get_future();
+
+	const unsigned int numThreads = (numCores == autoCores) ?
+		coresFor(numbersToSort.size()) : numCores;
+	ThreadPool& workers = poolFor(pool, std::max(numThreads, 2U) - 1);
+	workers.post([this, numCores, order, cancelled, done] () {
+		try {
+			sortUntil(numCores, order, cancelled.get());
+			if (*cancelled) {
+				throw std::system_error(std::make_error_code(std::errc::operation_canceled),
+					"BucketSort::sortAsync");
+			}
+			done->set_value();
+		} catch (...) {
+			done->set_exception(std::current_exception());
+		}
+	});
 	return result;
 }
-/* END VERBATIM FROM MATTHEW STARK */
 
-//sort the vector by creating numCores - 1 threads
-void BucketSort::sort(unsigned int numCores) {
+//stop the sort last started by sortAsync
+void BucketSort::cancel() {
+	if (_cancelled) {
+		*_cancelled = true;
+	}
+}
+
+//sort the vector using numCores - 1 threads from the pool
+//once cancelled is set, the numbers still to be sorted are left in place
+SortStats BucketSort::sortUntil(unsigned int numCores, Order order,
+const std::atomic<bool>* cancelled) {
+	if (numCores == autoCores) {
+		numCores = coresFor(numbersToSort.size());
+	}
+	ThreadPool* workers = (numCores == 1) ? nullptr : &poolFor(pool, numCores - 1);
+
+	//with stats compiled in, time each phase and count what the tasks do
+	SortContext context;
+	context.cancelled = cancelled;
+	context.scatter = scatter;
+	SortStats stats;
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point phaseStart;
+	std::size_t contendedBefore = 0;
+	if (statsEnabled) {
+		context.numThreads = workers ? workers->size() : 0;
+		context.numbersPerThread.reset(new std::atomic<std::size_t>[context.numThreads + 1]());
+		contendedBefore = workers ? workers->contendedLocks() : 0;
+		phaseStart = Clock::now();
+	}
+	auto endPhase = [&phaseStart] (long long& nanos) {
+		if (statsEnabled) {
+			const auto now = Clock::now();
+			nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(now - phaseStart).count();
+			phaseStart = now;
+		}
+	};
+	auto finish = [&context, &stats, workers, contendedBefore] () {
+		if (statsEnabled) {
+			for (unsigned int t = 0; t <= context.numThreads; ++t) {
+				stats.numbersPerThread.push_back(context.numbersPerThread[t]);
+			}
+			std::copy(context.rangesAtDigit, context.rangesAtDigit + 11, stats.rangesAtDigit.begin());
+			std::copy(context.bucketsOfSize, context.bucketsOfSize + 48, stats.bucketsOfSize.begin());
+			stats.contendedLocks = workers ? workers->contendedLocks() - contendedBefore : 0;
+		}
+		return stats;
+	};
+
+	if (order == Order::Numeric) {
+		numericSort(numbersToSort, numCores, pool);
+		endPhase(stats.bucketNanos);
+		return finish();
+	}
+
 	//sort in the current thread if no extra threads are available
 	if (numCores == 1) {
-		doSort(0);
-		return;
+		Arena::Scope scope(threadArena());
+		unsigned int* first = numbersToSort.data();
+		unsigned int* last = first + numbersToSort.size();
+		const bool presorted = sortPresorted(first, last, cutoff, nullptr, &context);
+		endPhase(stats.presortNanos);
+		if (!presorted) {
+			sortRange(first, last, 0, cutoff, nullptr, &context);
+			endPhase(stats.bucketNanos);
+		}
+		return finish();
 	}
 
 	//divide vector to sort & buckets into work for each thread
-	auto work = divideWork(numbersToSort.begin(), numbersToSort.end(), numCores - 1);
+	auto work = divideWork(numbersToSort.data(),
+		numbersToSort.data() + numbersToSort.size(), numCores - 1);
 	std::vector<unsigned int> msd = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
 	auto bucketRange = divideWork(msd.begin(), msd.end(), numCores - 1);
 
+	//map each msd straight to the bucket that contains it
+	unsigned int bucketOfMsd[10];
+	for (unsigned int i = 0; i < bucketRange.size(); ++i) {
+		for (auto it = bucketRange[i].first; it != bucketRange[i].second; ++it) {
+			bucketOfMsd[*it] = i;
+		}
+	}
+
 	//create as many buckets as there are cores available (-1 for main thread)
-	auto buckets = std::vector<BucketSort>(numCores - 1);
-
-	std::vector<std::thread> threads;
-	std::mutex m;
-
-	//relocate numbers to correct bucket
-	for (const auto& part: work) {
-		threads.emplace_back([&part, &bucketRange, &buckets, &m] () {
-			//each thread moves numbers to the right bucket, based on msd
-			std::for_each(part.first, part.second,
-			[&bucketRange, &buckets, &m] (const auto& n) {
-				std::string s = std::to_string(n); //get the msd
-				const unsigned int msd = s[0] - '0';
-
-				//find the bucket that contains the current msd
-				const auto found = std::find_if(bucketRange.begin(),
-				bucketRange.end(), [&msd] (const auto& val) {
-					return std::find(val.first, val.second, msd) != val.second;
-				}) - bucketRange.begin();
-
-				std::lock_guard<std::mutex> lg{m};
-				buckets[found].numbersToSort.emplace_back(n);
+	const unsigned int numBuckets = numCores - 1;
+
+	TaskGroup group;
+	const bool placed = pinThreads && workers->pin();
+
+	//nearly sorted input is finished off by merging instead
+	{
+		Arena::Scope scope(threadArena());
+		const bool presorted = sortPresorted(numbersToSort.data(),
+			numbersToSort.data() + numbersToSort.size(), cutoff, workers, &context);
+		endPhase(stats.presortNanos);
+		if (presorted || isCancelled(&context)) {
+			return finish();
+		}
+	}
+
+	//first pass: each thread counts how many of its numbers go in each bucket
+	std::vector<std::vector<std::size_t>> counts(work.size(),
+		std::vector<std::size_t>(numBuckets));
+	for (unsigned int t = 0; t < work.size(); ++t) {
+		workers->submit(group, [&work, &bucketOfMsd, &counts, t] () {
+			//bucket b holds the numbers with msd b - 1
+			auto& histogram = counts[t];
+			forEachBucket(work[t].first, work[t].second, 0,
+			[&bucketOfMsd, &histogram] (unsigned int, unsigned int b) {
+				++histogram[bucketOfMsd[b - 1]];
 			});
 		});
 	}
 
 	//wait for the threads to finish
-	for (auto& thread: threads) {
-		thread.join();
+	workers->wait(group);
+	endPhase(stats.countNanos);
+
+	//prefix sum the histograms, bucket by bucket and then thread by thread
+	//so each thread gets its own region of each bucket to write into
+	std::vector<std::size_t> bucketStart(numBuckets + 1);
+	std::vector<std::vector<std::size_t>> offsets(work.size(),
+		std::vector<std::size_t>(numBuckets));
+	std::size_t offset = 0;
+	for (unsigned int b = 0; b < numBuckets; ++b) {
+		bucketStart[b] = offset;
+		for (unsigned int t = 0; t < work.size(); ++t) {
+			offsets[t][b] = offset;
+			offset += counts[t][b];
+		}
 	}
-	threads.clear();
+	bucketStart[numBuckets] = offset;
 
-	//create a thread for each bucket & sort the bucket
-	for (auto& bucket: buckets) {
-		threads.emplace_back([&bucket] () {
-			//sort recursively, starting with the most significant digit
-			bucket.doSort(0);
+	//the output buffer is left uninitialised, so its pages are first touched
+	//(and placed on a numa node) by the threads that write to them
+	std::unique_ptr<unsigned int[]> scattered(new unsigned int[numbersToSort.size()]);
+
+	//with pinned workers, the worker that will sort each bucket touches its
+	//region first, so the bucket ends up on that worker's node
+	if (placed) {
+		for (unsigned int b = 0; b < numBuckets; ++b) {
+			workers->submitTo(b, group, [&bucketStart, &scattered, b] () {
+				std::fill(scattered.get() + bucketStart[b], scattered.get() + bucketStart[b + 1], 0);
+			});
+		}
+		workers->wait(group);
+	}
+
+	//second pass: relocate numbers to their place in the output buffer
+	//every thread writes to a disjoint region, so no locking is required
+	for (unsigned int t = 0; t < work.size(); ++t) {
+		workers->submit(group, [&work, &bucketOfMsd, &offsets, &scattered, &context, workers, t] () {
+			const std::size_t size = work[t].second - work[t].first;
+			countMoved(&context, workers, size);
+			auto& next = offsets[t];
+			bool nonTemporal;
+			if (!useBuffers(&context, size, nonTemporal)) {
+				forEachBucket(work[t].first, work[t].second, 0,
+				[&bucketOfMsd, &next, &scattered] (unsigned int n, unsigned int b) {
+					scattered[next[bucketOfMsd[b - 1]]++] = n;
+				});
+				return;
+			}
+			Arena& arena = threadArena();
+			Arena::Scope scope(arena);
+			ScatterBuffers out(scattered.get(), next.data(), next.size(),
+				arena.allocate<unsigned int>(next.size() * ScatterBuffers::lineSize),
+				arena.allocate<unsigned int>(next.size()), nonTemporal);
+			forEachBucket(work[t].first, work[t].second, 0,
+			[&bucketOfMsd, &out] (unsigned int n, unsigned int b) {
+				out.push(n, bucketOfMsd[b - 1]);
+			});
+			out.finish();
 		});
 	}
 
 	//wait for the threads to finish
-	for (auto& thread: threads) {
-		thread.join();
+	workers->wait(group);
+	endPhase(stats.scatterNanos);
+	for (unsigned int b = 0; b < numBuckets; ++b) {
+		countBucket(&context, bucketStart[b + 1] - bucketStart[b]);
 	}
 
-	//concatenate the sorted buckets
-	numbersToSort.clear();
-	for (unsigned int i = 0; i < numCores - 1; ++i) {
-		if (buckets[i].numbersToSort.size() > 0) {
-			numbersToSort.insert(numbersToSort.end(),
-			buckets[i].numbersToSort.begin(), buckets[i].numbersToSort.end());
+	//create a task for each bucket & sort the bucket
+	//pinned workers each get their own bucket, which they first touched
+	//above, so it is sorted in memory on the worker's node
+	for (unsigned int b = 0; b < numBuckets; ++b) {
+		auto task = [this, workers, &bucketStart, &scattered, b, &context] () {
+			unsigned int* first = scattered.get() + bucketStart[b];
+			unsigned int* last = scattered.get() + bucketStart[b + 1];
+
+			//sort recursively, starting with the most significant digit
+			//large sub-buckets become tasks that idle threads can steal
+			{
+				Arena::Scope scope(threadArena());
+				if (!sortPresorted(first, last, cutoff, workers, &context)) {
+					sortRange(first, last, 0, cutoff, workers, &context);
+				}
+			}
+
+			//the buckets are in order, so each is copied straight to its
+			//final place in the vector, in parallel with the others
+			//(even when cancelled, so that no numbers are lost)
+			std::copy(first, last, numbersToSort.data() + bucketStart[b]);
+		};
+		if (placed) {
+			workers->submitTo(b, group, task);
+		} else {
+			workers->submit(group, task);
 		}
 	}
+
+	//wait for the threads to finish
+	workers->wait(group);
+	endPhase(stats.bucketNanos);
+	return finish();
 }
 
 //sort a bucket based on the k-th most significant digit
+//if pool is set, large buckets are sorted by the pool's threads
+//a bucket that is (nearly) sorted already is finished off by merging
 void BucketSort::doSort(unsigned int k) {
-	//if less than 2 items or already sorted, return straight away
-	if (numbersToSort.size() < 2 || std::is_sorted(numbersToSort.begin(),
-	numbersToSort.end(), [] (const auto& x, const auto& y) {
-		return aLessB(x, y, 0);
-	})) {
+	//this is a top-level sort, so the scope gives back all that the
+	//recursion takes from this thread's arena
+	Arena::Scope scope(threadArena());
+
+	unsigned int* first = numbersToSort.data();
+	unsigned int* last = first + numbersToSort.size();
+	if (k == 0 && sortPresorted(first, last, cutoff, pool.get())) {
 		return;
 	}
+	sortRange(first, last, k, cutoff, pool.get());
+}
 
-	//create vector of 11 empty buckets
-	//each bucket corresponds to a possible k-th msd
-	//the first bucket stores numbers with k-th msd equal to -1 (padding)
-	//always create 11, rather than the max needed to reduce computations
-	//and to allow doSort to be called by a user if desired
+//partition [first, last) in place by the k-th msd (american flag sort)
+//counts is filled with the size of each of the 11 resulting buckets
+void flagPartition(unsigned int* first, unsigned int* last, unsigned int k,
+std::size_t* counts) {
 	const unsigned int numBuckets = 11;
-	auto buckets = std::vector<BucketSort>(numBuckets);
 
-	//place each number in the appropriate bucket
-	for (const auto& n: numbersToSort) {
-		//find the k-th most-significant digit
-		//set to -1 for padding if less than k digits in number
-		std::string s = std::to_string(n);
-		unsigned int msd = (k >= s.length()) ? -1 : s[k] - '0';
+	//count the numbers that belong in each bucket
+	std::fill(counts, counts + numBuckets, 0);
+	forEachBucket(first, last, k, [counts] (unsigned int, unsigned int b) {
+		++counts[b];
+	});
 
-		//place number in the bucket for the k-th msd
-		buckets[++msd].numbersToSort.emplace_back(n);
+	//work out where each bucket starts and ends
+	unsigned int* heads[numBuckets];
+	unsigned int* tails[numBuckets];
+	for (unsigned int b = 0; b < numBuckets; ++b) {
+		heads[b] = first;
+		first += counts[b];
+		tails[b] = first;
 	}
 
-	//sort each bucket recursively
-	const unsigned int nextDigit = k + 1; //i.e. shift to next msd
-	unsigned int i{0};
-	for (; i < numBuckets; ++i) {
-		if (buckets[i].numbersToSort.size() > 1) {
-			buckets[i].doSort(nextDigit);
+	//swap each number into its bucket, following cycles of displaced numbers
+	for (unsigned int b = 0; b < numBuckets; ++b) {
+		while (heads[b] < tails[b]) {
+			unsigned int n = *heads[b];
+			unsigned int found = bucketOf(n, k);
+			while (found != b) {
+				std::swap(n, *heads[found]++);
+				found = bucketOf(n, k);
+			}
+			*heads[b]++ = n;
+		}
+	}
+}
+
+//sort [first, last) in place, starting with the k-th msd
+//all numbers in the range share their first k digits
+void flagSort(unsigned int* first, unsigned int* last, unsigned int k,
+unsigned int cutoff) {
+	//insertion sort small ranges rather than partitioning them further
+	if (last - first < cutoff) {
+		insertionSort(first, last);
+		return;
+	}
+	if (last - first < 2) return;
+
+	std::size_t counts[11];
+	flagPartition(first, last, k, counts);
+
+	//numbers in the padding bucket have exactly k digits, so are all equal
+	first += counts[0];
+	for (unsigned int b = 1; b < 11; ++b) {
+		flagSort(first, first + counts[b], k + 1, cutoff);
+		first += counts[b];
+	}
+}
+
+//sort the vector in place using numCores - 1 threads from the pool
+void BucketSort::inPlaceSort(unsigned int numCores) {
+	if (numCores == autoCores) {
+		numCores = coresFor(numbersToSort.size());
+	}
+	unsigned int* first = numbersToSort.data();
+	unsigned int* last = first + numbersToSort.size();
+
+	//sort in the current thread if no extra threads are available
+	if (numCores == 1) {
+		flagSort(first, last, 0, cutoff);
+		return;
+	}
+
+	//partition by the msd, leaving the numbers for each msd contiguous
+	std::size_t counts[11];
+	flagPartition(first, last, 0, counts);
+	//every number has at least one digit, so the padding bucket is empty
+	unsigned int* msdStart[11];
+	msdStart[0] = first;
+	for (unsigned int d = 0; d < 10; ++d) {
+		msdStart[d + 1] = msdStart[d] + counts[d + 1];
+	}
+
+	//give each thread a range of msds to sort in place
+	std::vector<unsigned int> msd = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+	auto bucketRange = divideWork(msd.begin(), msd.end(), numCores - 1);
+
+	ThreadPool& workers = poolFor(pool, numCores - 1);
+	TaskGroup group;
+	for (const auto& range: bucketRange) {
+		workers.submit(group, [this, &range, &msdStart] () {
+			std::for_each(range.first, range.second, [this, &msdStart] (const auto& d) {
+				flagSort(msdStart[d], msdStart[d + 1], 1, cutoff);
+			});
+		});
+	}
+
+	//wait for the threads to finish
+	workers.wait(group);
+}
+
+//the split of each shard that puts the first rank numbers of their merge
+//before the splits (co-ranking): the key of the rank-th number is found by
+//binary search, then the numbers equal to it are taken from the shards in
+//order, so the splits for a larger rank are never before these
+static void coRank(const std::vector<std::vector<unsigned int>>& shards, std::size_t rank,
+std::size_t* splits) {
+	auto countBelow = [&shards] (unsigned long long key, std::size_t* below) {
+		std::size_t total = 0;
+		for (std::size_t s = 0; s < shards.size(); ++s) {
+			below[s] = std::partition_point(shards[s].begin(), shards[s].end(),
+			[key] (unsigned int n) { return lexKey(n) < key; }) - shards[s].begin();
+			total += below[s];
+		}
+		return total;
+	};
+
+	//find the smallest key with at least rank numbers at or below it
+	std::vector<std::size_t> below(shards.size());
+	unsigned long long low = 0, high = lexKey(999999999) + 1; //the largest key
+	while (low < high) {
+		const unsigned long long middle = low + (high - low) / 2;
+		if (countBelow(middle + 1, below.data()) >= rank) {
+			high = middle;
+		} else {
+			low = middle + 1;
+		}
+	}
+
+	//take the numbers below that key, then enough of those equal to it
+	std::size_t remaining = rank - countBelow(low, splits);
+	countBelow(low + 1, below.data());
+	for (std::size_t s = 0; s < shards.size(); ++s) {
+		const std::size_t take = std::min(remaining, below[s] - splits[s]);
+		splits[s] += take;
+		remaining -= take;
+	}
+}
+
+//merge [begins[s], ends[s]) of every shard into out
+//the shard with the smallest next key is found with a loser tree: each
+//node holds the shard that lost the match there, so replacing the winner
+//only replays the matches on its path, against keys that are kept rather
+//than worked out again
+static void mergeParts(const std::vector<std::vector<unsigned int>>& shards,
+const std::size_t* begins, const std::size_t* ends, unsigned int* out) {
+	const std::size_t numShards = shards.size();
+	std::size_t size = 0;
+	for (std::size_t s = 0; s < numShards; ++s) {
+		size += ends[s] - begins[s];
+	}
+	if (size == 0) {
+		return;
+	}
+
+	//the leaves are padded to a power of two with empty shards, whose key
+	//is larger than that of any number
+	const unsigned long long none = ~0ULL;
+	std::size_t numLeaves = 1;
+	while (numLeaves < numShards) {
+		numLeaves *= 2;
+	}
+	Arena& arena = threadArena();
+	Arena::Scope scope(arena);
+	unsigned long long* keys = arena.allocate<unsigned long long>(numLeaves);
+	const unsigned int** next = arena.allocate<const unsigned int*>(numLeaves);
+	const unsigned int** last = arena.allocate<const unsigned int*>(numLeaves);
+	std::size_t* losers = arena.allocate<std::size_t>(numLeaves);
+	std::size_t* winners = arena.allocate<std::size_t>(2 * numLeaves);
+	for (std::size_t s = 0; s < numLeaves; ++s) {
+		next[s] = last[s] = nullptr;
+		if (s < numShards) {
+			next[s] = shards[s].data() + begins[s];
+			last[s] = shards[s].data() + ends[s];
+		}
+		keys[s] = (next[s] != last[s]) ? lexKey(*next[s]) : none;
+		winners[numLeaves + s] = s;
+	}
+
+	//play the matches bottom up
+	for (std::size_t node = numLeaves - 1; node > 0; --node) {
+		const std::size_t left = winners[2 * node], right = winners[2 * node + 1];
+		const bool rightWins = keys[right] < keys[left];
+		winners[node] = rightWins ? right : left;
+		losers[node] = rightWins ? left : right;
+	}
+	std::size_t winner = (numLeaves == 1) ? 0 : winners[1];
+
+	//the winner keeps going until it passes the next smallest key (the
+	//smallest of those it beat), so runs are copied without replaying
+	unsigned int* const end = out + size;
+	while (out != end) {
+		unsigned long long bound = none;
+		for (std::size_t node = (numLeaves + winner) / 2; node > 0; node /= 2) {
+			bound = std::min(bound, keys[losers[node]]);
+		}
+		const unsigned int* from = next[winner];
+		const unsigned int* to = last[winner];
+		unsigned long long key = none;
+		do {
+			*out++ = *from++;
+		} while (from != to && (key = lexKey(*from)) <= bound);
+		next[winner] = from;
+		keys[winner] = (from != to) ? key : none;
+		for (std::size_t node = (numLeaves + winner) / 2; node > 0; node /= 2) {
+			if (keys[losers[node]] < keys[winner]) {
+				std::swap(winner, losers[node]);
+			}
 		}
 	}
+}
+
+//merge the sorted shards using numCores - 1 threads from the pool
+void BucketSort::mergeShards(const std::vector<std::vector<unsigned int>>& shards,
+unsigned int numCores) {
+	std::size_t total = 0;
+	for (const auto& shard: shards) {
+		total += shard.size();
+	}
+	if (numCores == autoCores) {
+		numCores = coresFor(total);
+	}
+	ThreadPool* workers = (numCores == 1) ? nullptr : &poolFor(pool, numCores - 1);
+
+	//check every shard is sorted before any is split or merged, so the
+	//vector is left as it was if one is not
+	std::atomic<bool> sorted{true};
+	{
+		TaskGroup group;
+		for (const auto& shard: shards) {
+			auto check = [&shard, &sorted] () {
+				if (!isLexSorted(shard.data(), shard.data() + shard.size())) {
+					sorted = false;
+				}
+			};
+			if (workers) {
+				workers->submit(group, check);
+			} else {
+				check();
+			}
+		}
+		if (workers) {
+			workers->wait(group);
+		}
+	}
+	if (!sorted) {
+		throw std::invalid_argument("BucketSort::mergeShards: shards must be sorted");
+	}
 
-	//combine all sorted buckets into original bucket
-	numbersToSort.clear();
-	for (i = 0; i < numBuckets; ++i) {
-		if (buckets[i].numbersToSort.size() > 0) {
-			numbersToSort.insert(numbersToSort.end(),
-			buckets[i].numbersToSort.begin(), buckets[i].numbersToSort.end());
+	//shards that each start where the one before ends (such as the ranges
+	//of a partitioned index) are just concatenated
+	bool disjoint = true;
+	const unsigned int* previous = nullptr;
+	for (const auto& shard: shards) {
+		if (shard.empty()) {
+			continue;
 		}
+		if (previous && lexKey(shard.front()) < lexKey(*previous)) {
+			disjoint = false;
+			break;
+		}
+		previous = &shard.back();
+	}
+	if (disjoint) {
+		std::vector<unsigned int> merged;
+		merged.reserve(total);
+		for (const auto& shard: shards) {
+			merged.insert(merged.end(), shard.begin(), shard.end());
+		}
+		numbersToSort.swap(merged);
+		return;
+	}
+
+	//split the output evenly between the threads, and find where each
+	//shard is split to fill each part
+	std::vector<unsigned int> merged(total);
+	const unsigned int numParts = std::max(numCores, 2U) - 1;
+	std::vector<std::vector<std::size_t>> splits(numParts + 1,
+		std::vector<std::size_t>(shards.size()));
+	for (unsigned int p = 1; p < numParts; ++p) {
+		coRank(shards, total * p / numParts, splits[p].data());
+	}
+	for (std::size_t s = 0; s < shards.size(); ++s) {
+		splits[numParts][s] = shards[s].size();
+	}
+
+	//each thread merges its part of the shards
+	if (!workers) {
+		mergeParts(shards, splits[0].data(), splits[1].data(), merged.data());
+	} else {
+		TaskGroup group;
+		for (unsigned int p = 0; p < numParts; ++p) {
+			workers->submit(group, [&shards, &splits, &merged, total, numParts, p] () {
+				mergeParts(shards, splits[p].data(), splits[p + 1].data(),
+					merged.data() + total * p / numParts);
+			});
+		}
+		workers->wait(group);
+	}
+	numbersToSort.swap(merged);
+}
+
+//put the first need numbers of [first, last) (in lexicographic order) at its
+//front, in order, based on the k-th most significant digit onwards
+//only the buckets before the one holding the need-th number are sorted, and
+//those after it are dropped; large ranges are counted and scattered in
+//parallel parts, so each level of the selection scales like sort
+static void selectRange(unsigned int* first, unsigned int* last, unsigned int k,
+std::size_t need, unsigned int cutoff, ThreadPool* workers) {
+	const std::size_t size = last - first;
+	if (need == 0) {
+		return;
+	}
+	if (need >= size || size < cutoff) {
+		sortRange(first, last, k, cutoff, workers);
+		return;
+	}
+
+	//run a task for each part, in parallel if the range is large enough
+	const unsigned int numBuckets = 11;
+	const std::size_t numParts = workers ?
+		std::max<std::size_t>(1, std::min<std::size_t>(workers->size() + 1, size / parallelGrain)) : 1;
+	auto runParts = [workers, numParts] (const auto& task) {
+		if (numParts == 1) {
+			task(0);
+			return;
+		}
+		TaskGroup group;
+		for (std::size_t p = 0; p < numParts; ++p) {
+			workers->submit(group, [&task, p] () { task(p); });
+		}
+		workers->wait(group);
+	};
+
+	//each part counts how many of its numbers go in each bucket
+	std::vector<std::vector<std::size_t>> counts(numParts, std::vector<std::size_t>(numBuckets));
+	runParts([first, size, k, numParts, &counts] (std::size_t p) {
+		auto& histogram = counts[p];
+		forEachBucket(first + size * p / numParts, first + size * (p + 1) / numParts, k,
+		[&histogram] (unsigned int, unsigned int b) {
+			++histogram[b];
+		});
+	});
+
+	//find the bucket holding the need-th number, keeping the buckets up to
+	//it and giving each part its own region of each of them
+	//(need is less than size, so some bucket holds it)
+	std::size_t starts[numBuckets + 1] = {};
+	unsigned int boundary = 0;
+	for (;; ++boundary) {
+		starts[boundary + 1] = starts[boundary];
+		for (std::size_t p = 0; p < numParts; ++p) {
+			const std::size_t count = counts[p][boundary];
+			counts[p][boundary] = starts[boundary + 1];
+			starts[boundary + 1] += count;
+		}
+		if (starts[boundary + 1] >= need) break;
+	}
+	const std::size_t kept = starts[boundary + 1];
+
+	//scatter the kept numbers in bucket order, then copy them to the front
+	{
+		Arena& arena = threadArena();
+		Arena::Scope scope(arena);
+		unsigned int* scratch = arena.allocate<unsigned int>(kept);
+		runParts([first, size, k, numParts, boundary, scratch, &counts] (std::size_t p) {
+			auto& next = counts[p];
+			forEachBucket(first + size * p / numParts, first + size * (p + 1) / numParts, k,
+			[&next, boundary, scratch] (unsigned int n, unsigned int b) {
+				if (b <= boundary) {
+					scratch[next[b]++] = n;
+				}
+			});
+		});
+		runParts([first, kept, numParts, scratch] (std::size_t p) {
+			std::copy(scratch + kept * p / numParts, scratch + kept * (p + 1) / numParts,
+				first + kept * p / numParts);
+		});
+	}
+
+	//sort the buckets before the boundary, and select from the boundary
+	//numbers in the padding bucket have exactly k digits, so are all equal
+	const unsigned int nextDigit = k + 1;
+	TaskGroup group;
+	for (unsigned int b = 1; b < boundary; ++b) {
+		unsigned int* bucketFirst = first + starts[b];
+		unsigned int* bucketLast = first + starts[b + 1];
+		if (workers && bucketLast - bucketFirst >= static_cast<std::ptrdiff_t>(parallelGrain)) {
+			workers->submit(group, [bucketFirst, bucketLast, nextDigit, cutoff, workers] () {
+				sortRange(bucketFirst, bucketLast, nextDigit, cutoff, workers);
+			});
+		} else if (bucketLast - bucketFirst > 1) {
+			sortRange(bucketFirst, bucketLast, nextDigit, cutoff, workers);
+		}
+	}
+	if (boundary > 0) {
+		selectRange(first + starts[boundary], first + kept, nextDigit,
+			need - starts[boundary], cutoff, workers);
+	}
+	if (workers) {
+		workers->wait(group);
+	}
+}
+
+//keep only the first count numbers (all of them if there are fewer), in
+//order, using numCores - 1 threads from the pool
+void BucketSort::partialSort(std::size_t count, unsigned int numCores) {
+	count = std::min(count, numbersToSort.size());
+	if (numCores == autoCores) {
+		numCores = coresFor(numbersToSort.size());
+	}
+	ThreadPool* workers = (numCores == 1) ? nullptr : &poolFor(pool, numCores - 1);
+
+	//nearly sorted input is merged whole, as sort would, which is cheaper
+	//than selecting from it bucket by bucket
+	Arena::Scope scope(threadArena());
+	unsigned int* first = numbersToSort.data();
+	unsigned int* last = first + numbersToSort.size();
+	if (!sortPresorted(first, last, cutoff, workers)) {
+		selectRange(first, last, 0, count, cutoff, workers);
 	}
+	numbersToSort.resize(count);
 }
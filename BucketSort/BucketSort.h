@@ -6,20 +6,94 @@
 #ifndef BUCKET_SORT_H
 #define BUCKET_SORT_H
 
+#include <atomic>
+#include <future>
+#include <memory>
 #include <vector>
+#include "SortStats.h"
+
+class ThreadPool;
 
 struct BucketSort {
+	//the order numbers can be sorted in: lexicographic by their decimal
+	//digits (e.g. 10 before 9), or plain numeric order
+	enum class Order { Lexicographic, Numeric };
+
 	//vector of numbers
 	std::vector<unsigned int> numbersToSort;
 
+	//buckets smaller than this are insertion sorted rather than split up
+	unsigned int cutoff = 32;
+
+	//worker threads, created by the first multi-threaded sort and reused
+	//after that; a pool can also be shared between several BucketSorts
+	std::shared_ptr<ThreadPool> pool;
+
+	//pin the pool's workers to cores and have each worker first touch the
+	//memory of the buckets it sorts, so they stay on its numa node
+	//(has no effect on single-node systems)
+	bool pinThreads = false;
+
+	//how sort moves numbers into their buckets: straight to their place,
+	//or gathered a cache line per bucket and written out a line at a time
+	//(see ScatterBuffers.h), optionally with non-temporal stores
+	//buffering only pays off on machines where the scattered writes miss,
+	//so it is off unless asked for
+	enum class Scatter { Direct, Buffered, NonTemporal };
+	Scatter scatter = Scatter::Direct;
+
 	//single-threaded sorting function
 	void simpleSort();
 
+	//passed as numCores to any of the sorts (including those of the other
+	//sort classes) to have the number of cores chosen from the size of the
+	//input by coresFor
+	static constexpr unsigned int autoCores = 0;
+
+	//the number of cores worth sorting size numbers with, up to the number
+	//the hardware has; 1 (sort on the calling thread) for small vectors
+	//the choice is based on costs measured on first use
+	static unsigned int coresFor(std::size_t size);
+
 	//multi-threaded sorting function
-	void sort(unsigned int numCores);
+	//numeric order uses a parallel LSD radix sort rather than buckets
+	//returns where the time went (empty unless compiled with BUCKETSORT_STATS)
+	SortStats sort(unsigned int numCores, Order order = Order::Lexicographic);
+
+	//start sort(numCores, order) on the pool and return straight away
+	//neither the vector nor this object may be touched until the future is
+	//ready; if the sort is cancelled first, the future throws a
+	//std::system_error (std::errc::operation_canceled) and the vector holds
+	//the same numbers in no particular order
+	std::future<void> sortAsync(unsigned int numCores, Order order = Order::Lexicographic);
+
+	//stop the sort last started by sortAsync as soon as possible
+	//(numeric order sorts are not stopped, but still report cancellation)
+	void cancel();
 
 	//parallel bucket sort helper
+	//if pool is set, large buckets are sorted by the pool's threads
 	void doSort(unsigned int k);
+
+	//multi-threaded sorting function that permutes the vector in place
+	void inPlaceSort(unsigned int numCores);
+
+	//keep only the first count numbers in lexicographic order, sorted
+	//buckets that cannot hold any of them are dropped without sorting
+	void partialSort(std::size_t count, unsigned int numCores);
+
+	//set the vector to the merge of shards, each of which must already be in
+	//the order simpleSort gives (otherwise std::invalid_argument is thrown
+	//and the vector is left as it was); the output is split evenly between
+	//numCores - 1 threads
+	void mergeShards(const std::vector<std::vector<unsigned int>>& shards,
+		unsigned int numCores);
+private:
+	//sort, leaving the numbers still to be sorted once cancelled is set
+	SortStats sortUntil(unsigned int numCores, Order order, const std::atomic<bool>* cancelled);
+
+	//set by cancel to stop the sort last started by sortAsync
+	std::shared_ptr<std::atomic<bool>> _cancelled;
 };
 
 #endif
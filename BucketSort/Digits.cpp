@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Vectorised digit classification for the Parallel Bucket Sort.
+ *
+ * Works out the bucket of 8 (AVX2) or 4 (SSE4.1) numbers at once. The
+ * length of each number comes from comparing it against every power of
+ * ten, and the k-th digit from dividing by the right power of ten as a
+ * double, which is exact for 32-bit numbers. The instruction set is chosen
+ * at runtime, falling back to the scalar bucketOf on other cpus.
+ */
+
+#include "Digits.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DIGITS_X86
+#endif
+
+//powers of ten as doubles, for dividing in vector registers
+alignas(64) static const double powersOfTenDouble[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
+
+static void bucketsOfScalar(const unsigned int* numbers, std::size_t n, unsigned int k,
+unsigned char* buckets) {
+	for (std::size_t i = 0; i < n; ++i) {
+		buckets[i] = bucketOf(numbers[i], k);
+	}
+}
+
+#ifdef DIGITS_X86
+
+//the digit at 10^e of 4 numbers, given as x ^ 0x80000000
+__attribute__((target("avx2")))
+static inline __m128i digitsAvx2(__m128i x, __m128i e) {
+	const __m256d ten = _mm256_set1_pd(10.0);
+	const __m256d d = _mm256_add_pd(_mm256_cvtepi32_pd(x), _mm256_set1_pd(2147483648.0));
+	const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+	const __m256d p = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), powersOfTenDouble, e,
+		all, 8);
+	const __m256d q = _mm256_floor_pd(_mm256_div_pd(d, p));
+	const __m256d tens = _mm256_floor_pd(_mm256_div_pd(q, ten));
+	return _mm256_cvttpd_epi32(_mm256_sub_pd(q, _mm256_mul_pd(tens, ten)));
+}
+
+__attribute__((target("avx2")))
+static void bucketsOfAvx2(const unsigned int* numbers, std::size_t n, unsigned int k,
+unsigned char* buckets) {
+	//compare unsigned numbers with signed instructions by flipping the sign bit
+	const __m256i sign = _mm256_set1_epi32(0x80000000);
+	__m256i thresholds[maxDigits];
+	for (unsigned int i = 1; i < maxDigits; ++i) {
+		thresholds[i] = _mm256_set1_epi32((powersOfTen[i] - 1) ^ 0x80000000);
+	}
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i kv = _mm256_set1_epi32(k);
+	const __m256i kPlusOne = _mm256_set1_epi32(k + 1);
+
+	alignas(32) unsigned int result[8];
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256i x = _mm256_xor_si256(_mm256_loadu_si256(
+			reinterpret_cast<const __m256i*>(numbers + i)), sign);
+
+		//each comparison that holds is -1, so subtracting adds one digit
+		__m256i len = one;
+		for (unsigned int j = 1; j < maxDigits; ++j) {
+			len = _mm256_sub_epi32(len, _mm256_cmpgt_epi32(x, thresholds[j]));
+		}
+
+		//divide by 10^(len - k - 1); lanes with no k-th digit use 10^0
+		const __m256i valid = _mm256_cmpgt_epi32(len, kv);
+		const __m256i e = _mm256_max_epi32(_mm256_sub_epi32(len, kPlusOne),
+			_mm256_setzero_si256());
+
+		const __m128i low = digitsAvx2(_mm256_castsi256_si128(x), _mm256_castsi256_si128(e));
+		const __m128i high = digitsAvx2(_mm256_extracti128_si256(x, 1),
+			_mm256_extracti128_si256(e, 1));
+		const __m256i d = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+
+		//numbers with at most k digits go in the padding bucket 0
+		_mm256_store_si256(reinterpret_cast<__m256i*>(result),
+			_mm256_and_si256(_mm256_add_epi32(d, one), valid));
+		for (unsigned int j = 0; j < 8; ++j) {
+			buckets[i + j] = result[j];
+		}
+	}
+	bucketsOfScalar(numbers + i, n - i, k, buckets + i);
+}
+
+//the digit at 10^e0 and 10^e1 of the low 2 numbers of x ^ 0x80000000
+__attribute__((target("sse4.1")))
+static inline __m128i digitsSse41(__m128i x, unsigned int e0, unsigned int e1) {
+	const __m128d ten = _mm_set1_pd(10.0);
+	const __m128d d = _mm_add_pd(_mm_cvtepi32_pd(x), _mm_set1_pd(2147483648.0));
+	const __m128d p = _mm_set_pd(powersOfTenDouble[e1], powersOfTenDouble[e0]);
+	const __m128d q = _mm_floor_pd(_mm_div_pd(d, p));
+	const __m128d tens = _mm_floor_pd(_mm_div_pd(q, ten));
+	return _mm_cvttpd_epi32(_mm_sub_pd(q, _mm_mul_pd(tens, ten)));
+}
+
+__attribute__((target("sse4.1")))
+static void bucketsOfSse41(const unsigned int* numbers, std::size_t n, unsigned int k,
+unsigned char* buckets) {
+	const __m128i sign = _mm_set1_epi32(0x80000000);
+	__m128i thresholds[maxDigits];
+	for (unsigned int i = 1; i < maxDigits; ++i) {
+		thresholds[i] = _mm_set1_epi32((powersOfTen[i] - 1) ^ 0x80000000);
+	}
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i kv = _mm_set1_epi32(k);
+	const __m128i kPlusOne = _mm_set1_epi32(k + 1);
+
+	alignas(16) unsigned int result[4];
+	std::size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m128i x = _mm_xor_si128(_mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(numbers + i)), sign);
+
+		__m128i len = one;
+		for (unsigned int j = 1; j < maxDigits; ++j) {
+			len = _mm_sub_epi32(len, _mm_cmpgt_epi32(x, thresholds[j]));
+		}
+
+		const __m128i valid = _mm_cmpgt_epi32(len, kv);
+		const __m128i e = _mm_max_epi32(_mm_sub_epi32(len, kPlusOne), _mm_setzero_si128());
+
+		const __m128i low = digitsSse41(x, _mm_extract_epi32(e, 0), _mm_extract_epi32(e, 1));
+		const __m128i high = digitsSse41(_mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)),
+			_mm_extract_epi32(e, 2), _mm_extract_epi32(e, 3));
+		const __m128i d = _mm_unpacklo_epi64(low, high);
+
+		_mm_store_si128(reinterpret_cast<__m128i*>(result),
+			_mm_and_si128(_mm_add_epi32(d, one), valid));
+		for (unsigned int j = 0; j < 4; ++j) {
+			buckets[i + j] = result[j];
+		}
+	}
+	bucketsOfScalar(numbers + i, n - i, k, buckets + i);
+}
+
+#endif
+
+//work out the best instruction set once, using cpuid
+static SimdLevel detectSimdLevel() {
+#ifdef DIGITS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return SimdLevel::Avx2;
+	if (__builtin_cpu_supports("sse4.1")) return SimdLevel::Sse41;
+#endif
+	return SimdLevel::Scalar;
+}
+
+SimdLevel supportedSimdLevel() {
+	static const SimdLevel level = detectSimdLevel();
+	return level;
+}
+
+void bucketsOf(const unsigned int* numbers, std::size_t n, unsigned int k,
+unsigned char* buckets, SimdLevel level) {
+	switch (level) {
+#ifdef DIGITS_X86
+	case SimdLevel::Avx2:
+		bucketsOfAvx2(numbers, n, k, buckets);
+		return;
+	case SimdLevel::Sse41:
+		bucketsOfSse41(numbers, n, k, buckets);
+		return;
+#endif
+	default:
+		bucketsOfScalar(numbers, n, k, buckets);
+	}
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Integer digit extraction for the Parallel Bucket Sort.
+ *
+ * Works out the decimal digits of an unsigned integer using only integer
+ * arithmetic, so no strings are allocated while sorting.
+ */
+
+#ifndef DIGITS_H
+#define DIGITS_H
+
+#include <cstddef>
+#include <algorithm>
+
+//powers of ten that fit in an unsigned int
+constexpr unsigned int powersOfTen[] = {
+	1U, 10U, 100U, 1000U, 10000U, 100000U, 1000000U, 10000000U, 100000000U,
+	1000000000U
+};
+
+//the maximum number of decimal digits in an unsigned int
+constexpr unsigned int maxDigits = 10;
+
+//the number of decimal digits in n (0 has a single digit)
+inline unsigned int numDigits(unsigned int n) {
+	//estimate the length from the number of bits, then correct by one
+	//n | 1 has the same number of digits as n, but avoids clz(0)
+	const unsigned int m = n | 1;
+	const unsigned int t = ((32 - __builtin_clz(m)) * 1233) >> 12;
+	return t + (m >= powersOfTen[t]);
+}
+
+//ceil(2^64 / 10^e), so n / 10^e is the high half of n * reciprocal
+//this is exact for every 32-bit n and avoids a hardware division
+//10^0 has no 64-bit reciprocal, so is handled separately
+constexpr unsigned long long tenReciprocals[] = {
+	0ULL, 0x199999999999999aULL, 0x28f5c28f5c28f5dULL, 0x4189374bc6a7f0ULL,
+	0x68db8bac710ccULL, 0xa7c5ac471b48ULL, 0x10c6f7a0b5eeULL, 0x1ad7f29abcbULL,
+	0x2af31dc462ULL, 0x44b82fa0aULL
+};
+
+//n divided by 10^e
+inline unsigned int divPow10(unsigned int n, unsigned int e) {
+	if (e == 0) return n;
+	return static_cast<unsigned int>(
+		(static_cast<unsigned __int128>(n) * tenReciprocals[e]) >> 64);
+}
+
+//the k-th most significant digit of n, given that n has len digits (k < len)
+inline unsigned int digitAt(unsigned int n, unsigned int k, unsigned int len) {
+	return divPow10(n, len - k - 1) % 10;
+}
+
+//the bucket for n based on its k-th most significant digit
+//bucket 0 holds numbers with at most k digits (padding), 1-10 hold digits 0-9
+inline unsigned int bucketOf(unsigned int n, unsigned int k) {
+	const unsigned int len = numDigits(n);
+	return (k >= len) ? 0 : digitAt(n, k, len) + 1;
+}
+
+//a 64-bit key that orders unsigned integers lexicographically
+//the digits are padded with zeros to the maximum length, and the length is
+//kept in the lowest 4 bits so that a prefix (e.g. 12 vs 120) comes first
+inline unsigned long long lexKey(unsigned int n) {
+	const unsigned int len = numDigits(n);
+	const unsigned long long padded =
+		static_cast<unsigned long long>(n) * powersOfTen[maxDigits - len];
+	return (padded << 4) | len;
+}
+
+//the unsigned integer that a lexicographic key was made from
+inline unsigned int fromLexKey(unsigned long long key) {
+	const unsigned int len = key & 0xf;
+	return static_cast<unsigned int>((key >> 4) / powersOfTen[maxDigits - len]);
+}
+
+//compares two unsigned integers lexicographically by their decimal digits
+inline bool lexLess(unsigned int a, unsigned int b) {
+	return lexKey(a) < lexKey(b);
+}
+
+//powers of ten that fit in an unsigned long long
+constexpr unsigned long long powersOfTen64[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+	100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL,
+	1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+	1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+	1000000000000000000ULL, 10000000000000000000ULL
+};
+
+//the number of decimal digits in a 64-bit n (0 has a single digit)
+inline unsigned int numDigits64(unsigned long long n) {
+	const unsigned long long m = n | 1;
+	const unsigned int t = ((64 - __builtin_clzll(m)) * 1233) >> 12;
+	return t + (m >= powersOfTen64[t]);
+}
+
+//the most significant digit of n
+inline unsigned int leadingDigit(unsigned int n) {
+	return divPow10(n, numDigits(n) - 1);
+}
+
+//the instruction sets that bucketsOf can use
+enum class SimdLevel { Scalar, Sse41, Avx2 };
+
+//the best instruction set supported by this cpu (checked once with cpuid)
+SimdLevel supportedSimdLevel();
+
+//set buckets[i] to bucketOf(numbers[i], k) for each of the n numbers,
+//several numbers at a time if the level allows it
+void bucketsOf(const unsigned int* numbers, std::size_t n, unsigned int k,
+	unsigned char* buckets, SimdLevel level = supportedSimdLevel());
+
+//call fn(n, bucketOf(n, k)) for each n in [first, last)
+//the buckets are worked out a block at a time with bucketsOf
+template <typename Fn>
+void forEachBucket(const unsigned int* first, const unsigned int* last, unsigned int k,
+Fn fn) {
+	const std::size_t blockSize = 256;
+	unsigned char buckets[blockSize];
+	while (first != last) {
+		const std::size_t n = std::min<std::size_t>(blockSize, last - first);
+		bucketsOf(first, n, k, buckets);
+		for (std::size_t i = 0; i < n; ++i) {
+			fn(first[i], buckets[i]);
+		}
+		first += n;
+	}
+}
+
+#endif
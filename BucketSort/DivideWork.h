@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Splits a range into work for each thread of the Parallel Bucket Sort.
+ */
+
+#ifndef DIVIDE_WORK_H
+#define DIVIDE_WORK_H
+
+#include <vector>
+#include <cstddef>
+#include <utility>
+#include <iterator>
+
+//divide a vector into components of work based on the number of cores n
+//credit to Matthew Stark (COMP6771 Lecturer, 2017)
+/* BEGIN VERBATIM FROM MATTHEW STARK */
+template <typename It>
+std::vector<std::pair<It, It>> divideWork(It begin, It end, unsigned n) {
+	auto dis = std::distance(begin, end);
+	auto npercore = (dis / n) + 1;
+	auto extras = dis % n;
+	std::vector<std::pair<It, It>> result;
+	for (auto i = 0U; i < n; ++i) {
+		if (i == extras)
+			--npercore;
+		result.emplace_back(begin, begin + npercore);
+		begin += npercore;
+	}
+	return result;
+}
+/* END VERBATIM FROM MATTHEW STARK */
+
+//buckets with at least this many numbers are sorted as separate tasks
+constexpr std::size_t parallelGrain = 16384;
+
+#endif
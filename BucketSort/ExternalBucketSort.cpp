@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Implementation of the External Parallel Bucket Sort.
+ */
+
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ExternalBucketSort.h"
+#include "BucketSort.h"
+#include "Digits.h"
+
+//numbers buffered for each spill run before they are written out
+static const std::size_t spillBufferSize = 1 << 16;
+
+//throw the error in errno, saying what was being done
+[[noreturn]] static void throwErrno(const std::string& what) {
+	throw std::system_error(errno, std::generic_category(), "ExternalBucketSort: " + what);
+}
+
+//closes a file descriptor when it goes out of scope
+struct FileDescriptor {
+	int fd;
+
+	explicit FileDescriptor(int fd) : fd{fd} {}
+	FileDescriptor(const FileDescriptor&) = delete;
+	FileDescriptor(FileDescriptor&& other) : fd{other.fd} { other.fd = -1; }
+	~FileDescriptor() { if (fd != -1) close(fd); }
+};
+
+//a read-only view of the start of a file that is unmapped when it goes out
+//of scope
+struct Mapping {
+	const unsigned int* data;
+	std::size_t bytes;
+
+	Mapping(int fd, std::size_t bytes) : bytes{bytes} {
+		void* addr = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED) throwErrno("mmap");
+		madvise(addr, bytes, MADV_SEQUENTIAL);
+		data = static_cast<const unsigned int*>(addr);
+	}
+	Mapping(const Mapping&) = delete;
+	~Mapping() { munmap(const_cast<unsigned int*>(data), bytes); }
+};
+
+//write all the bytes to fd, retrying short writes
+static void writeAll(int fd, const void* data, std::size_t bytes) {
+	const char* p = static_cast<const char*>(data);
+	while (bytes > 0) {
+		const ssize_t written = write(fd, p, bytes);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			throwErrno("write");
+		}
+		p += written;
+		bytes -= written;
+	}
+}
+
+//create an unnamed file in directory for a spill run
+static FileDescriptor spillFile(const std::string& directory) {
+	std::vector<char> path(directory.begin(), directory.end());
+	const std::string name = "/bucketsort.XXXXXX";
+	path.insert(path.end(), name.begin(), name.end());
+	path.push_back('\0');
+
+	const int fd = mkstemp(path.data());
+	if (fd == -1) throwErrno("creating a spill run in " + directory);
+	unlink(path.data());
+	return FileDescriptor{fd};
+}
+
+//a temporary file holding the numbers of one bucket
+struct SpillRun {
+	FileDescriptor file;
+	std::vector<unsigned int> buffer;
+	std::size_t count = 0;
+
+	explicit SpillRun(FileDescriptor&& file) : file{std::move(file)} {
+		buffer.reserve(spillBufferSize);
+	}
+
+	void flush() {
+		writeAll(file.fd, buffer.data(), buffer.size() * sizeof(unsigned int));
+		count += buffer.size();
+		buffer.clear();
+	}
+};
+
+//sort the file in inputPath into outputPath using numCores - 1 threads
+//when sorting each run in memory
+void ExternalBucketSort::sort(unsigned int numCores) {
+	FileDescriptor input{open(inputPath.c_str(), O_RDONLY)};
+	if (input.fd == -1) throwErrno("opening " + inputPath);
+
+	struct stat info;
+	if (fstat(input.fd, &info) == -1) throwErrno("stat " + inputPath);
+	const std::size_t bytes = info.st_size;
+	if (bytes % sizeof(unsigned int) != 0) {
+		throw std::invalid_argument("ExternalBucketSort: " + inputPath +
+			" is not a whole number of unsigned ints");
+	}
+
+	FileDescriptor output{open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+	if (output.fd == -1) throwErrno("opening " + outputPath);
+
+	sortRun(input.fd, bytes / sizeof(unsigned int), 0, output.fd, numCores);
+}
+
+void ExternalBucketSort::sortRun(int fd, std::size_t count, unsigned int k, int out,
+unsigned int numCores) {
+	if (count == 0) return;
+	const std::size_t bytes = count * sizeof(unsigned int);
+
+	//sort runs that fit in memory with the parallel sort
+	//every number in a run shares its first k digits, so the whole run sorts
+	//the same as it would in the full file
+	if (bytes <= memoryLimit) {
+		BucketSort b;
+		{
+			Mapping input(fd, bytes);
+			b.numbersToSort.assign(input.data, input.data + count);
+		}
+		b.pool = pool;
+		b.sort(numCores);
+		pool = b.pool; //keep the pool if the sort created one
+		writeAll(out, b.numbersToSort.data(), bytes);
+		return;
+	}
+
+	//spill each number to the run for its k-th digit
+	std::vector<SpillRun> runs;
+	{
+		Mapping input(fd, bytes);
+
+		//a run of one number repeated is sorted already, so is copied out
+		//however large it is; this is always the case once every digit has
+		//been used, and otherwise saves a spill pass per digit left
+		if (k >= maxDigits || std::adjacent_find(input.data, input.data + count,
+		std::not_equal_to<unsigned int>()) == input.data + count) {
+			writeAll(out, input.data, bytes);
+			return;
+		}
+
+		for (unsigned int b = 0; b < 11; ++b) {
+			runs.emplace_back(spillFile(spillDirectory));
+		}
+		forEachBucket(input.data, input.data + count, k,
+		[&runs] (unsigned int n, unsigned int b) {
+			runs[b].buffer.push_back(n);
+			if (runs[b].buffer.size() == spillBufferSize) {
+				runs[b].flush();
+			}
+		});
+	}
+	for (auto& run: runs) {
+		run.flush();
+		std::vector<unsigned int>().swap(run.buffer);
+	}
+
+	//numbers in the padding bucket have exactly k digits, so are all equal
+	//and come before the rest
+	if (runs[0].count > 0) {
+		Mapping equal(runs[0].file.fd, runs[0].count * sizeof(unsigned int));
+		writeAll(out, equal.data, equal.bytes);
+	}
+
+	//free the disk space of each run once it has been sorted
+	for (unsigned int b = 1; b < runs.size(); ++b) {
+		sortRun(runs[b].file.fd, runs[b].count, k + 1, out, numCores);
+		if (ftruncate(runs[b].file.fd, 0) == -1) throwErrno("ftruncate");
+	}
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Interface for the External Parallel Bucket Sort.
+ *
+ * Sorts a binary file of native-endian unsigned integers that may be larger
+ * than memory, in the same lexicographic order as BucketSort. The input is
+ * memory-mapped and its numbers are spilled to a temporary run per leading
+ * digit. Each run that fits in memory is sorted with the parallel sort and
+ * appended to the output file; runs that are still too large are split
+ * again on their next digit.
+ */
+
+#ifndef EXTERNAL_BUCKET_SORT_H
+#define EXTERNAL_BUCKET_SORT_H
+
+#include <memory>
+#include <string>
+#include <cstddef>
+
+class ThreadPool;
+
+struct ExternalBucketSort {
+	//file of numbers to sort
+	std::string inputPath;
+
+	//file the sorted numbers are written to (replaced if it exists)
+	std::string outputPath;
+
+	//directory the spill runs are created in; they are removed as soon as
+	//they are created, so nothing is left behind if the sort fails
+	std::string spillDirectory = "/tmp";
+
+	//the most bytes of numbers sorted in memory at once
+	std::size_t memoryLimit = std::size_t(1) << 30;
+
+	//worker threads, created by the first multi-threaded sort and reused
+	std::shared_ptr<ThreadPool> pool;
+
+	//multi-threaded sorting function
+	void sort(unsigned int numCores);
+
+	//sort the count numbers in fd by their k-th digit onwards and append them
+	//to out, spilling them to runs first if they do not fit in memory
+	void sortRun(int fd, std::size_t count, unsigned int k, int out, unsigned int numCores);
+};
+
+#endif
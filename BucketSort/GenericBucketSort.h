@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Interface for the Generic Parallel Bucket Sort.
+ *
+ * Sorts keys of any type in lexicographic order using the same parallel MSD
+ * radix sort as BucketSort. The symbols of each key are given by a digit
+ * extractor, which must provide:
+ *   radix            the number of distinct symbols
+ *   operator()(k, i) 0 if key k has at most i symbols, otherwise one more
+ *                    than the i-th symbol of k (so 1 to radix)
+ *   less(a, b)       true if key a comes before key b
+ */
+
+#ifndef GENERIC_BUCKET_SORT_H
+#define GENERIC_BUCKET_SORT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+#include "Digits.h"
+
+class ThreadPool;
+
+//the decimal digits of an integer, ordered as their std::to_string would be
+//negative numbers start with a '-' symbol, which comes before every digit
+template <typename T> struct DecimalDigits {
+	static_assert(std::is_integral<T>::value, "DecimalDigits needs an integer type");
+	static_assert(sizeof(T) <= sizeof(unsigned long long), "integer type is too large");
+
+	static constexpr unsigned int radix = std::is_signed<T>::value ? 11 : 10;
+
+	unsigned int operator()(const T& key, unsigned int k) const;
+	bool less(const T& a, const T& b) const;
+};
+
+//the bytes of a std::string, ordered as std::string's operator<
+struct StringDigits {
+	static constexpr unsigned int radix = 256;
+
+	unsigned int operator()(const std::string& key, unsigned int k) const {
+		return (k >= key.size()) ? 0 : static_cast<unsigned char>(key[k]) + 1;
+	}
+
+	bool less(const std::string& a, const std::string& b) const {
+		return a < b;
+	}
+};
+
+//the bytes of a null-terminated string, ordered as std::strcmp
+//only the pointers are moved, so the characters are never copied
+struct CStringDigits {
+	static constexpr unsigned int radix = 255;
+
+	//the terminating null is symbol 0, so the key ends there
+	unsigned int operator()(const char* key, unsigned int k) const {
+		return static_cast<unsigned char>(key[k]);
+	}
+
+	bool less(const char* a, const char* b) const {
+		return std::strcmp(a, b) < 0;
+	}
+};
+
+//the digit extractor used for a key type unless another is given
+template <typename Key> struct DefaultDigits {
+	using type = DecimalDigits<Key>;
+};
+
+template <> struct DefaultDigits<std::string> {
+	using type = StringDigits;
+};
+
+template <> struct DefaultDigits<const char*> {
+	using type = CStringDigits;
+};
+
+template <typename Key, typename Digits = typename DefaultDigits<Key>::type>
+struct GenericBucketSort {
+	//vector of keys
+	std::vector<Key> keysToSort;
+
+	//ranges smaller than this are insertion sorted rather than split up
+	unsigned int cutoff = 32;
+
+	//worker threads, created by the first multi-threaded sort and reused
+	std::shared_ptr<ThreadPool> pool;
+
+	//gives the symbols of each key
+	Digits digits;
+
+	//single-threaded sorting function
+	void simpleSort();
+
+	//multi-threaded sorting function
+	void sort(unsigned int numCores);
+
+	//sort [first, last) starting with the k-th symbol, using scratch (of the
+	//same size) as temporary storage; large buckets are given to workers
+	void doSort(Key* first, Key* last, Key* scratch, unsigned int k,
+		ThreadPool* workers);
+};
+
+#include "GenericBucketSort.tem"
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Interface for the Key-Value Parallel Bucket Sort.
+ *
+ * Sorts unsigned keys in lexicographic order while carrying a payload with
+ * each key. The keys are sorted together with the index of their payload
+ * using the generic parallel MSD sort, then each payload is moved straight
+ * to its final place, so large payloads are only moved once.
+ */
+
+#ifndef KEY_VALUE_BUCKET_SORT_H
+#define KEY_VALUE_BUCKET_SORT_H
+
+#include <memory>
+#include <vector>
+#include "Digits.h"
+#include "GenericBucketSort.h"
+
+class ThreadPool;
+
+//a key and the index of its payload
+struct KeyIndex {
+	unsigned int key;
+	unsigned int index;
+};
+
+//the decimal digits of the key of a KeyIndex, ordered as BucketSort
+struct KeyIndexDigits {
+	static constexpr unsigned int radix = 10;
+
+	unsigned int operator()(const KeyIndex& e, unsigned int k) const {
+		return bucketOf(e.key, k);
+	}
+
+	bool less(const KeyIndex& a, const KeyIndex& b) const {
+		return lexKey(a.key) < lexKey(b.key);
+	}
+};
+
+//payloads must be default constructible and movable
+//keys that are equal keep the original order of their payloads
+template <typename Payload> struct KeyValueBucketSort {
+	//vector of keys
+	std::vector<unsigned int> keysToSort;
+
+	//the payload of each key (must be the same size as keysToSort)
+	std::vector<Payload> payloads;
+
+	//worker threads, created by the first multi-threaded sort and reused
+	std::shared_ptr<ThreadPool> pool;
+
+	//multi-threaded sorting function
+	void sort(unsigned int numCores);
+};
+
+//sort records by an unsigned key taken from each record by key(record)
+//the records must be default constructible and movable
+template <typename Record, typename Projection>
+void sortByKey(std::vector<Record>& records, Projection key, unsigned int numCores,
+	std::shared_ptr<ThreadPool> pool = nullptr);
+
+#include "KeyValueBucketSort.tem"
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Software write combining for the scatter of the Parallel Bucket Sort.
+ *
+ * Moving each number straight to its bucket touches a different cache line
+ * (and often page) on every write once the buckets are large. Instead, the
+ * numbers headed for each bucket are gathered in a cache line sized buffer,
+ * and the buffer is written to the bucket a whole line at a time. Each line
+ * of the destination is then written once, while the buffers (one line per
+ * bucket) stay in the L1 cache. The lines can also be written with
+ * non-temporal stores, which skip reading each line into the cache first
+ * and leave the cache to the data that is about to be sorted.
+ */
+
+#ifndef SCATTER_BUFFERS_H
+#define SCATTER_BUFFERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+class ScatterBuffers {
+public:
+	//numbers that fit in a 64-byte cache line
+	static constexpr unsigned int lineSize = 16;
+
+	//scatter into dst, where bucket b starts at next[b]; next is moved
+	//along as numbers are written, as if they were written directly
+	//lines must hold numBuckets * lineSize numbers and be 64-byte aligned
+	ScatterBuffers(unsigned int* dst, std::size_t* next, unsigned int numBuckets,
+	unsigned int* lines, unsigned int* fill, bool nonTemporal) : _dst{dst},
+	_next{next}, _numBuckets{numBuckets}, _lines{lines}, _fill{fill},
+	_nonTemporal{nonTemporal} {
+		//each buffer starts at the position of its bucket within a line,
+		//so that every later flush writes exactly one aligned line
+		for (unsigned int b = 0; b < numBuckets; ++b) {
+			_fill[b] = lineOffset(dst + next[b]);
+		}
+	}
+
+	ScatterBuffers(const ScatterBuffers& s) = delete;
+	ScatterBuffers& operator=(const ScatterBuffers& s) = delete;
+
+	//add n to bucket b
+	void push(unsigned int n, unsigned int b) {
+		unsigned int* line = _lines + b * lineSize;
+		line[_fill[b]] = n;
+		if (++_fill[b] == lineSize) {
+			flushLine(b, line);
+		}
+	}
+
+	//write out what is left in the buffers
+	//must be called before the numbers in dst are read
+	void finish() {
+		for (unsigned int b = 0; b < _numBuckets; ++b) {
+			const unsigned int start = lineOffset(_dst + _next[b]);
+			const unsigned int* line = _lines + b * lineSize;
+			std::copy(line + start, line + _fill[b], _dst + _next[b]);
+			_next[b] += _fill[b] - start;
+		}
+#if defined(__SSE2__)
+		//non-temporal stores are weakly ordered, so are fenced before the
+		//numbers are handed to another thread
+		if (_nonTemporal) {
+			_mm_sfence();
+		}
+#endif
+	}
+private:
+	//where p falls within its cache line, in numbers
+	static unsigned int lineOffset(const unsigned int* p) {
+		return (reinterpret_cast<std::uintptr_t>(p) / sizeof(unsigned int)) % lineSize;
+	}
+
+	//write the full buffer of bucket b to the bucket
+	void flushLine(unsigned int b, const unsigned int* line) {
+		unsigned int* dst = _dst + _next[b];
+		const unsigned int start = lineOffset(dst);
+		if (start == 0) {
+#if defined(__SSE2__)
+			if (_nonTemporal) {
+				const __m128i* from = reinterpret_cast<const __m128i*>(line);
+				__m128i* to = reinterpret_cast<__m128i*>(dst);
+				_mm_stream_si128(to, _mm_load_si128(from));
+				_mm_stream_si128(to + 1, _mm_load_si128(from + 1));
+				_mm_stream_si128(to + 2, _mm_load_si128(from + 2));
+				_mm_stream_si128(to + 3, _mm_load_si128(from + 3));
+			} else {
+				std::copy(line, line + lineSize, dst);
+			}
+#else
+			std::copy(line, line + lineSize, dst);
+#endif
+		} else {
+			//the first line of a bucket that does not start on a line
+			std::copy(line + start, line + lineSize, dst);
+		}
+		_next[b] += lineSize - start;
+		_fill[b] = 0;
+	}
+
+	unsigned int* _dst; //where the buckets are
+	std::size_t* _next; //where the next line of each bucket goes
+	unsigned int _numBuckets;
+	unsigned int* _lines; //a line per bucket
+	unsigned int* _fill; //numbers in each line, counting from its start
+	bool _nonTemporal; //write full lines with non-temporal stores
+};
+
+#endif
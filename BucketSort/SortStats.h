@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Counters describing where a Parallel Bucket Sort spent its time.
+ *
+ * The counters are only kept when compiled with BUCKETSORT_STATS defined
+ * (make STATS=1). Otherwise sort returns an empty SortStats, and the code
+ * that would fill it in is compiled out.
+ */
+
+#ifndef SORT_STATS_H
+#define SORT_STATS_H
+
+#include <array>
+#include <vector>
+#include <cstddef>
+
+#ifdef BUCKETSORT_STATS
+constexpr bool statsEnabled = true;
+#else
+constexpr bool statsEnabled = false;
+#endif
+
+struct SortStats {
+	//false if the counters were compiled out, in which case all are zero
+	bool enabled = statsEnabled;
+
+	//wall clock nanoseconds spent in each phase of the top level
+	long long presortNanos = 0; //looking for (and merging) nearly sorted input
+	long long countNanos = 0; //counting the size of each top-level bucket
+	long long scatterNanos = 0; //moving the numbers into their buckets
+	long long bucketNanos = 0; //sorting the buckets and writing them back
+
+	//numbers moved into buckets by each worker, at the top level and while
+	//splitting buckets; the last entry is threads outside the pool
+	std::vector<std::size_t> numbersPerThread;
+
+	//ranges split (or found sorted) on each digit, 0 being the most
+	//significant, which shows how deep the recursion went
+	std::array<std::size_t, 11> rangesAtDigit{};
+
+	//buckets split off, by size: bucketsOfSize[i] counts those with
+	//2^i to 2^(i + 1) - 1 numbers
+	std::array<std::size_t, 48> bucketsOfSize{};
+
+	//times a thread found a task queue of the pool locked by another
+	//(counted for the whole pool, so includes other sorts sharing it)
+	std::size_t contendedLocks = 0;
+};
+
+#endif
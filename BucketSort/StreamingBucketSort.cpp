@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Implementation of the Streaming Parallel Bucket Sort.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "StreamingBucketSort.h"
+#include "ThreadPool.h"
+
+StreamingBucketSort::StreamingBucketSort(std::size_t windowSize, unsigned int numCores,
+Sink sink, std::shared_ptr<ThreadPool> pool) : _windowSize{windowSize},
+_numCores{numCores}, _sink{std::move(sink)} {
+	if (windowSize == 0) {
+		throw std::invalid_argument("StreamingBucketSort: windowSize must not be 0");
+	}
+
+	//the windows share one pool, which needs a worker to sort in the
+	//background even with one core
+	const unsigned int numThreads = (numCores == BucketSort::autoCores) ?
+		BucketSort::coresFor(windowSize) : numCores;
+	poolFor(pool, std::max(numThreads, 2U) - 1);
+	for (auto& window: _windows) {
+		window.pool = pool;
+		window.numbersToSort.reserve(windowSize);
+	}
+}
+
+StreamingBucketSort::~StreamingBucketSort() {
+	if (_sorting.valid()) {
+		_sorting.wait();
+	}
+}
+
+void StreamingBucketSort::push(const unsigned int* numbers, std::size_t count) {
+	while (count > 0) {
+		auto& window = _windows[_filling].numbersToSort;
+		const std::size_t taken = std::min(count, _windowSize - window.size());
+		window.insert(window.end(), numbers, numbers + taken);
+		numbers += taken;
+		count -= taken;
+		if (window.size() == _windowSize) {
+			startSort();
+		}
+	}
+}
+
+void StreamingBucketSort::push(const std::vector<unsigned int>& numbers) {
+	push(numbers.data(), numbers.size());
+}
+
+void StreamingBucketSort::finish() {
+	if (!_windows[_filling].numbersToSort.empty()) {
+		startSort();
+	}
+	passOn();
+}
+
+void StreamingBucketSort::startSort() {
+	//only two windows are kept, so the other one must be passed on before
+	//it can be filled again
+	passOn();
+	_sorting = _windows[_filling].sortAsync(_numCores);
+	_filling ^= 1;
+}
+
+void StreamingBucketSort::passOn() {
+	if (!_sorting.valid()) {
+		return;
+	}
+	_sorting.get();
+	auto& window = _windows[_filling ^ 1].numbersToSort;
+	_sink(window);
+
+	//clearing keeps the capacity, so the window is refilled without allocating
+	window.clear();
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Interface for the Streaming Parallel Bucket Sort.
+ *
+ * Sorts an unbounded stream of numbers in fixed-size windows, each in the
+ * same lexicographic order as BucketSort, without holding more than two
+ * windows in memory. Numbers are pushed into one window while the window
+ * before it is sorted in the background on the pool (double buffering).
+ * Each sorted window is handed to a sink, in the order the windows were
+ * filled, from within push or finish.
+ */
+
+#ifndef STREAMING_BUCKET_SORT_H
+#define STREAMING_BUCKET_SORT_H
+
+#include <future>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <functional>
+#include "BucketSort.h"
+
+class ThreadPool;
+
+class StreamingBucketSort {
+public:
+	//receives each window once it is sorted; the window is reused after the
+	//sink returns, so the sink must copy out anything it wants to keep
+	using Sink = std::function<void(const std::vector<unsigned int>& window)>;
+
+	//constructor: windows of windowSize numbers are sorted with numCores
+	//cores (or BucketSort::autoCores) on pool, which is created if null
+	//throws std::invalid_argument if windowSize is 0
+	StreamingBucketSort(std::size_t windowSize, unsigned int numCores, Sink sink,
+		std::shared_ptr<ThreadPool> pool = nullptr);
+
+	//destructor: waits for the window being sorted, without passing it on
+	~StreamingBucketSort();
+
+	StreamingBucketSort(const StreamingBucketSort& s) = delete;
+	StreamingBucketSort& operator=(const StreamingBucketSort& s) = delete;
+
+	//add count numbers to the stream
+	//each window that fills up starts sorting in the background, once the
+	//window before it has been sorted and passed to the sink
+	void push(const unsigned int* numbers, std::size_t count);
+	void push(const std::vector<unsigned int>& numbers);
+
+	//sort the last, partly filled window and pass every window still
+	//outstanding to the sink; more numbers may be pushed afterwards
+	void finish();
+private:
+	void startSort(); //sort the window being filled and fill the other
+	void passOn(); //wait for the window being sorted and give it to the sink
+
+	const std::size_t _windowSize;
+	const unsigned int _numCores;
+	Sink _sink;
+	BucketSort _windows[2]; //one being filled, the other being sorted
+	unsigned int _filling{0}; //the index of the window being filled
+	std::future<void> _sorting; //the sort of the other window, if any
+};
+
+#endif
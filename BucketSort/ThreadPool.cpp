@@ -0,0 +1,403 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Implementation of the thread pool used by the Parallel Bucket Sort.
+ *
+ * Creating and joining threads for every call to sort is expensive when
+ * sorting many small vectors, so the workers are created once and reused.
+ *
+ * Tasks are scheduled by work stealing: a task submitted by a worker goes
+ * on the back of that worker's own queue, and the worker takes its newest
+ * task first, so recursion stays depth first and cache friendly. A worker
+ * with nothing to do steals the oldest (and usually largest) task from the
+ * front of another worker's queue.
+ */
+
+#include <limits>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <algorithm>
+#include "ThreadPool.h"
+#include "SortStats.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+//index used for threads that are not workers of the pool
+constexpr unsigned int notAWorker = std::numeric_limits<unsigned int>::max();
+
+//the pool that the current thread works for, and its index in that pool
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local unsigned int currentWorker = notAWorker;
+
+//nanoseconds the current thread has spent inside wait, which is not counted
+//as busy time for the task that called it
+thread_local long long waitingTime = 0;
+
+//nanoseconds since start
+static long long nanosSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+ThreadPool::ThreadPool(unsigned int numThreads) :
+_capacity{std::max({numThreads, 2 * std::thread::hardware_concurrency(), 64U})},
+_workers{new Worker[_capacity]}, _size{0}, _queued{0}, _sleeping{0} {
+	reserve(numThreads);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lg{_m};
+		_stopping = true;
+	}
+	_wake.notify_all();
+	for (unsigned int i = 0; i < _size; ++i) {
+		_workers[i].thread.join();
+	}
+}
+
+unsigned int ThreadPool::size() const {
+	return _size;
+}
+
+void ThreadPool::reserve(unsigned int numThreads) {
+	std::lock_guard<std::mutex> lg{_m};
+	numThreads = std::min(numThreads, _capacity);
+	while (_size < numThreads) {
+		const unsigned int self = _size;
+		_workers[self].thread = std::thread([this, self] () { work(self); });
+		pinWorker(self);
+		++_size;
+	}
+}
+
+void ThreadPool::submit(TaskGroup& group, std::function<void()> task) {
+	//workers keep their own tasks, everyone else uses the shared queue
+	push((currentPool == this) ? _workers[currentWorker] : _shared, group, std::move(task));
+}
+
+void ThreadPool::submitTo(unsigned int worker, TaskGroup& group,
+std::function<void()> task) {
+	if (worker >= _size) {
+		submit(group, std::move(task));
+		return;
+	}
+	Worker& owner = _workers[worker];
+	++group._pending;
+	{
+		auto lock = lockQueue(owner);
+		owner.placed.push_back(Task{std::move(task), &group});
+	}
+	++owner.numPlaced;
+
+	//only the owner can run it, so every sleeping thread is woken to make
+	//sure the owner is among them
+	std::lock_guard<std::mutex> lg{_m};
+	_wake.notify_all();
+}
+
+void ThreadPool::post(std::function<void()> task) {
+	++_posted._pending;
+	{
+		auto lock = lockQueue(_postedTasks);
+		_postedTasks.tasks.push_back(Task{std::move(task), &_posted});
+	}
+	++_numPosted;
+
+	//a thread sleeping in wait would not take it, so wake every sleeper to
+	//be sure an idle worker sees it
+	std::lock_guard<std::mutex> lg{_m};
+	_wake.notify_all();
+}
+
+//parse a list of cpus such as "0-3,8,10-11"
+static std::vector<unsigned int> parseCpuList(const std::string& list) {
+	std::vector<unsigned int> cpus;
+	std::istringstream in(list);
+	std::string range;
+	while (std::getline(in, range, ',')) {
+		if (range.empty() || range == "\n") continue;
+		const auto dash = range.find('-');
+		const unsigned int first = std::stoul(range.substr(0, dash));
+		const unsigned int last = (dash == std::string::npos) ? first :
+			std::stoul(range.substr(dash + 1));
+		for (unsigned int cpu = first; cpu <= last; ++cpu) {
+			cpus.push_back(cpu);
+		}
+	}
+	return cpus;
+}
+
+//the cpus this process may run on, grouped by numa node
+static std::vector<std::vector<unsigned int>> cpusByNode() {
+	std::vector<std::vector<unsigned int>> nodes;
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		return nodes;
+	}
+
+	//nodes are numbered from 0, but there may be gaps
+	const unsigned int maxNodes = 1024;
+	for (unsigned int node = 0; node < maxNodes; ++node) {
+		std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		if (!file) continue;
+		std::string list;
+		std::getline(file, list);
+
+		std::vector<unsigned int> cpus;
+		for (auto cpu: parseCpuList(list)) {
+			if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+				cpus.push_back(cpu);
+			}
+		}
+		if (!cpus.empty()) {
+			nodes.push_back(cpus);
+		}
+	}
+#endif
+	return nodes;
+}
+
+bool ThreadPool::pin() {
+	std::lock_guard<std::mutex> lg{_m};
+	if (!_cores.empty()) {
+		return true;
+	}
+
+	//there is no remote memory to avoid on a single node
+	//(the nodes are only looked up once, as that reads many sysfs files)
+	if (_singleNode) {
+		return false;
+	}
+	const auto nodes = cpusByNode();
+	if (nodes.size() < 2) {
+		_singleNode = true;
+		return false;
+	}
+
+	//deal the cores out one node at a time, so worker i is on node i % nodes
+	std::size_t mostCores = 0;
+	for (const auto& cpus: nodes) {
+		mostCores = std::max(mostCores, cpus.size());
+	}
+	for (std::size_t i = 0; i < mostCores; ++i) {
+		for (const auto& cpus: nodes) {
+			if (i < cpus.size()) {
+				_cores.push_back(cpus[i]);
+			}
+		}
+	}
+
+	for (unsigned int self = 0; self < _size; ++self) {
+		pinWorker(self);
+	}
+	return true;
+}
+
+void ThreadPool::pinWorker(unsigned int self) {
+#ifdef __linux__
+	if (_cores.empty()) {
+		return;
+	}
+	cpu_set_t cores;
+	CPU_ZERO(&cores);
+	CPU_SET(_cores[self % _cores.size()], &cores);
+	pthread_setaffinity_np(_workers[self].thread.native_handle(), sizeof(cores), &cores);
+#endif
+}
+
+unsigned int ThreadPool::currentIndex() const {
+	return (currentPool == this) ? currentWorker : _size.load();
+}
+
+std::size_t ThreadPool::contendedLocks() const {
+	return _contended;
+}
+
+std::unique_lock<std::mutex> ThreadPool::lockQueue(Worker& queue) {
+	if (statsEnabled) {
+		std::unique_lock<std::mutex> lock{queue.m, std::try_to_lock};
+		if (lock.owns_lock()) {
+			return lock;
+		}
+		++_contended;
+	}
+	return std::unique_lock<std::mutex>{queue.m};
+}
+
+std::vector<std::chrono::nanoseconds> ThreadPool::busyTimes() const {
+	std::vector<std::chrono::nanoseconds> times;
+	for (unsigned int i = 0; i < _size; ++i) {
+		times.emplace_back(_workers[i].busy.load());
+	}
+	times.emplace_back(_shared.busy.load());
+	return times;
+}
+
+void ThreadPool::resetBusyTimes() {
+	for (unsigned int i = 0; i < _size; ++i) {
+		_workers[i].busy = 0;
+	}
+	_shared.busy = 0;
+}
+
+void ThreadPool::push(Worker& queue, TaskGroup& group, std::function<void()> task) {
+	++group._pending;
+	{
+		auto lock = lockQueue(queue);
+		queue.tasks.push_back(Task{std::move(task), &group});
+	}
+	++_queued;
+
+	//wake a sleeping thread to run it
+	if (_sleeping > 0) {
+		std::lock_guard<std::mutex> lg{_m};
+		_wake.notify_one();
+	}
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+	const unsigned int self = (currentPool == this) ? currentWorker : notAWorker;
+	const long long waited = waitingTime;
+	const auto start = std::chrono::steady_clock::now();
+	Task task;
+	while (group._pending > 0) {
+		if (take(self, false, task)) {
+			finish(task);
+			continue;
+		}
+
+		//nothing to help with, so sleep until the group is done or
+		//there is more work to do
+		std::unique_lock<std::mutex> lock{_m};
+		++_sleeping;
+		_wake.wait(lock, [this, &group, self] () {
+			return group._pending == 0 || hasWork(self, false);
+		});
+		--_sleeping;
+	}
+
+	//tasks run meanwhile may have waited too, but that is already included
+	waitingTime = waited + nanosSince(start);
+}
+
+bool ThreadPool::hasWork(unsigned int self, bool idle) const {
+	return _queued > 0 || (self != notAWorker && _workers[self].numPlaced > 0) ||
+		(idle && _numPosted > 0);
+}
+
+bool ThreadPool::take(unsigned int self, bool idle, Task& task) {
+	if (!hasWork(self, idle)) {
+		return false;
+	}
+
+	//tasks placed on this worker, then the newest task from our own queue
+	if (self != notAWorker) {
+		Worker& own = _workers[self];
+		auto lock = lockQueue(own);
+		if (!own.placed.empty()) {
+			task = std::move(own.placed.front());
+			own.placed.pop_front();
+			--own.numPlaced;
+			return true;
+		}
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			--_queued;
+			return true;
+		}
+	}
+
+	//oldest task submitted from outside the pool
+	{
+		auto lock = lockQueue(_shared);
+		if (!_shared.tasks.empty()) {
+			task = std::move(_shared.tasks.front());
+			_shared.tasks.pop_front();
+			--_queued;
+			return true;
+		}
+	}
+
+	//oldest task of another worker, starting with our neighbour
+	const unsigned int size = _size;
+	const unsigned int start = (self == notAWorker) ? 0 : self + 1;
+	for (unsigned int i = 0; i < size; ++i) {
+		Worker& victim = _workers[(start + i) % size];
+		auto lock = lockQueue(victim);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			--_queued;
+			return true;
+		}
+	}
+
+	//once the running sorts need no help, an idle worker starts another
+	if (idle) {
+		auto lock = lockQueue(_postedTasks);
+		if (!_postedTasks.tasks.empty()) {
+			task = std::move(_postedTasks.tasks.front());
+			_postedTasks.tasks.pop_front();
+			--_numPosted;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::work(unsigned int self) {
+	currentPool = this;
+	currentWorker = self;
+
+	Task task;
+	while (true) {
+		if (take(self, true, task)) {
+			finish(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock{_m};
+		++_sleeping;
+		_wake.wait(lock, [this, self] () { return _stopping || hasWork(self, true); });
+		--_sleeping;
+		if (_stopping && !hasWork(self, true)) {
+			return;
+		}
+	}
+}
+
+void ThreadPool::finish(Task& task) {
+	//time the task against the thread that ran it, leaving out time spent
+	//waiting on subtasks (those run meanwhile are timed on their own)
+	Worker& runner = (currentPool == this) ? _workers[currentWorker] : _shared;
+	const long long waited = waitingTime;
+	const auto start = std::chrono::steady_clock::now();
+	task.run();
+	runner.busy += nanosSince(start) - (waitingTime - waited);
+	TaskGroup* group = task.group;
+	task.run = nullptr;
+
+	//the last task of a group wakes anyone waiting on it
+	//take the lock so a waiter cannot miss the notification
+	if (--group->_pending == 0) {
+		std::lock_guard<std::mutex> lg{_m};
+		_wake.notify_all();
+	}
+}
+
+ThreadPool& poolFor(std::shared_ptr<ThreadPool>& pool, unsigned int numThreads) {
+	if (!pool) {
+		pool = std::make_shared<ThreadPool>(numThreads);
+	} else {
+		pool->reserve(numThreads);
+	}
+	return *pool;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Interface for the thread pool used by the Parallel Bucket Sort.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+//a set of tasks submitted to a pool that can be waited on together
+class TaskGroup {
+public:
+	TaskGroup() : _pending{0} { }
+	TaskGroup(const TaskGroup& g) = delete;
+	TaskGroup& operator=(const TaskGroup& g) = delete;
+private:
+	friend class ThreadPool;
+	std::atomic<std::size_t> _pending; //tasks submitted but not yet finished
+};
+
+//a set of worker threads that is kept alive and reused between sorts
+//each worker has its own queue of tasks, and idle workers steal from others
+class ThreadPool {
+public:
+	//constructor: starts numThreads workers
+	explicit ThreadPool(unsigned int numThreads);
+
+	//destructor: finishes any queued tasks and joins the workers
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool& p) = delete;
+	ThreadPool& operator=(const ThreadPool& p) = delete;
+
+	//the number of worker threads
+	unsigned int size() const;
+
+	//start more workers so that there are at least numThreads
+	//(up to the capacity fixed when the pool was constructed)
+	void reserve(unsigned int numThreads);
+
+	//queue a task to be run as part of group
+	//tasks submitted by a worker go on its own queue, others are shared
+	void submit(TaskGroup& group, std::function<void()> task);
+
+	//queue a task that only the given worker runs, so that memory it
+	//touches first is placed on that worker's node; it is never stolen,
+	//so waiting threads and idle workers leave it for its worker
+	void submitTo(unsigned int worker, TaskGroup& group, std::function<void()> task);
+
+	//queue a task that nobody waits on, such as one that drives a whole sort
+	//and reports back through a future; the destructor still runs it
+	//only idle workers run these, never a thread helping out inside wait,
+	//so a short sort cannot get stuck behind an unrelated one
+	void post(std::function<void()> task);
+
+	//pin each worker (including those started later) to its own core,
+	//spreading consecutive workers across the numa nodes
+	//returns false, leaving the workers unpinned, on single-node systems
+	bool pin();
+
+	//the index of the calling thread among the workers, or size() if it is
+	//not one of them
+	unsigned int currentIndex() const;
+
+	//times a thread has found a task queue locked by another thread
+	//(only counted when compiled with BUCKETSORT_STATS)
+	std::size_t contendedLocks() const;
+
+	//the time each worker has spent running tasks since the last reset
+	//the last entry is the time spent by threads outside the pool
+	std::vector<std::chrono::nanoseconds> busyTimes() const;
+	void resetBusyTimes();
+
+	//block until every task in group has finished
+	//the calling thread runs queued tasks while it waits, so tasks may
+	//submit and wait on their own subtasks
+	void wait(TaskGroup& group);
+private:
+	struct Task {
+		std::function<void()> run;
+		TaskGroup* group;
+	};
+
+	struct Worker {
+		std::mutex m; //guards tasks and placed
+		std::deque<Task> tasks; //the owner takes from the back, thieves the front
+		std::deque<Task> placed; //tasks only the owner may run, oldest first
+		std::atomic<std::size_t> numPlaced{0}; //tasks in placed
+		std::thread thread;
+		std::atomic<long long> busy{0}; //nanoseconds spent running tasks
+	};
+
+	void push(Worker& queue, TaskGroup& group, std::function<void()> task); //queue a task
+	bool hasWork(unsigned int self, bool idle) const; //whether worker self may find a task
+	bool take(unsigned int self, bool idle, Task& task); //find a task for worker self
+	void work(unsigned int self); //the loop run by each worker
+	void finish(Task& task); //run a task and mark it as finished
+	void pinWorker(unsigned int self); //pin a started worker to its core
+	std::unique_lock<std::mutex> lockQueue(Worker& queue); //lock a task queue
+
+	const unsigned int _capacity; //the most workers the pool can have
+	std::unique_ptr<Worker[]> _workers; //the workers
+	std::atomic<unsigned int> _size; //the number of workers started
+	Worker _shared; //tasks submitted from outside the pool
+	Worker _postedTasks; //tasks queued by post, which only idle workers take
+	std::atomic<std::size_t> _numPosted{0}; //tasks in _postedTasks
+	std::atomic<std::size_t> _queued; //tasks waiting in any queue, except placed ones
+	std::atomic<unsigned int> _sleeping; //threads blocked on _wake
+	std::mutex _m; //guards _stopping and starting workers
+	std::condition_variable _wake; //signalled when tasks are queued or finish
+	bool _stopping{false}; //true once the destructor has been called
+	std::vector<unsigned int> _cores; //the core of each worker once pinned
+	bool _singleNode{false}; //pin found a single numa node, so never pins
+	TaskGroup _posted; //tasks queued by post
+	std::atomic<std::size_t> _contended{0}; //queue locks that were already held
+};
+
+//get the pool to run tasks on, with at least numThreads workers
+//a pool is created on first use and kept for later sorts
+ThreadPool& poolFor(std::shared_ptr<ThreadPool>& pool, unsigned int numThreads);
+
+#endif
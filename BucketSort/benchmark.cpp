@@ -3,65 +3,769 @@
 #include <thread>
 #include <cassert>
 #include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
 #include <chrono>
+#include <cmath>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "BucketSort.h"
+#include "Digits.h"
+#include "SortStats.h"
+#include "StreamingBucketSort.h"
+#include "ThreadPool.h"
+
+// count every allocation made through operator new
+std::atomic<std::size_t> allocationCount{0};
+
+void *operator new(std::size_t size) {
+    ++allocationCount;
+    if (void *p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
 
 constexpr auto numreps = 10U;
+constexpr auto numwarmups = 2U;
 constexpr auto totalNumbers = 10000000U;
 
-int main() {
+// millions of numbers processed per second
+double throughput(std::size_t numbers, std::chrono::high_resolution_clock::duration d) {
+    return numbers / std::chrono::duration<double, std::micro>(d).count();
+}
 
-    std::mt19937 mt(std::random_device{}());
-    std::uniform_int_distribution<unsigned int> dist(1, std::numeric_limits<unsigned int>::max());
-    std::uniform_real_distribution<float> floatdist(std::numeric_limits<float>::min(), std::numeric_limits<float>::max());
-
-    std::vector<std::pair<std::function<unsigned int()>, std::string>> dataSets = {
-        {[&] { return dist(mt); }, "Uniform random distribution"},
-        {[&] { return (dist(mt) / 1000) * 1000; }, "Common value distribution"},
-        //{[&] { return reinterpret_cast<unsigned int>(floatdist(mt)); }, "Extreme distribution"},
-        {[] { return 0; }, "All zeros"},
-        {[] { return std::numeric_limits<unsigned int>::max(); }, "All max int"},
-        {[] {
-            static unsigned int upto = 0U;
-            return ++upto;
-        }, "Monotomically increasing"},
-    };
+// compare the old string based digit extraction against the integer one
+// each pass finds a single digit of every number, like a level of doSort
+void benchmarkDigits(const std::vector<unsigned int> &data, const std::string &desc) {
+    unsigned long long before = 0, after = 0;
 
-    const unsigned int numCores = std::thread::hardware_concurrency();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto k = 0U; k < maxDigits; ++k) {
+        for (auto n : data) {
+            const std::string s = std::to_string(n);
+            before += (k >= s.length()) ? 0 : s[k] - '0' + 1;
+        }
+    }
+    auto stringTime = std::chrono::high_resolution_clock::now() - start;
 
-    std::ofstream results("results.csv");
-    results << totalNumbers << '\n';
-    for (const auto &dataset : dataSets) {
-        const auto &generator = dataset.first;
-        const auto &desc = dataset.second;
+    start = std::chrono::high_resolution_clock::now();
+    for (auto k = 0U; k < maxDigits; ++k) {
+        for (auto n : data) {
+            after += bucketOf(n, k);
+        }
+    }
+    auto integerTime = std::chrono::high_resolution_clock::now() - start;
 
+    unsigned long long vectorised = 0;
+    std::vector<unsigned char> buckets(data.size());
+    start = std::chrono::high_resolution_clock::now();
+    for (auto k = 0U; k < maxDigits; ++k) {
+        bucketsOf(data.data(), data.size(), k, buckets.data());
+        for (auto b : buckets) {
+            vectorised += b;
+        }
+    }
+    auto vectorisedTime = std::chrono::high_resolution_clock::now() - start;
+
+    assert(before == after && after == vectorised);
+    std::cout << desc << ": digit extraction " << throughput(data.size() * maxDigits, stringTime)
+              << " -> " << throughput(data.size() * maxDigits, integerTime)
+              << " -> " << throughput(data.size() * maxDigits, vectorisedTime)
+              << " million digits/s (vectorised at level " << static_cast<int>(supportedSimdLevel()) << ")" << std::endl;
+}
+
+// sort the data with a range of insertion sort cutoffs
+void sweepCutoff(const std::vector<unsigned int> &data, const std::string &desc, unsigned int numCores) {
+    for (auto cutoff : {0U, 2U, 8U, 16U, 32U, 64U, 128U, 256U}) {
         BucketSort b;
-        std::vector<unsigned int> data;
-        // insert random numbers into the sort object
-        for (unsigned int i=0; i < totalNumbers; ++i) {
-            data.push_back(generator());
+        b.numbersToSort = data;
+        b.cutoff = cutoff;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        b.sort(numCores);
+        auto elapsed = std::chrono::high_resolution_clock::now() - start;
+        std::cout << desc << ": cutoff " << cutoff << ": "
+                  << throughput(data.size(), elapsed) << " million numbers/s" << std::endl;
+    }
+}
+
+// compare std::sort, the numeric radix sort and the lexicographic sort
+void benchmarkOrders(const std::vector<unsigned int> &data, const std::string &desc, unsigned int numCores) {
+    auto copy = data;
+    auto start = std::chrono::high_resolution_clock::now();
+    std::sort(copy.begin(), copy.end());
+    auto stdTime = std::chrono::high_resolution_clock::now() - start;
+
+    BucketSort numeric;
+    numeric.numbersToSort = data;
+    start = std::chrono::high_resolution_clock::now();
+    numeric.sort(numCores, BucketSort::Order::Numeric);
+    auto numericTime = std::chrono::high_resolution_clock::now() - start;
+    assert(numeric.numbersToSort == copy);
+
+    BucketSort lexicographic;
+    lexicographic.numbersToSort = data;
+    start = std::chrono::high_resolution_clock::now();
+    lexicographic.sort(numCores);
+    auto lexicographicTime = std::chrono::high_resolution_clock::now() - start;
+
+    std::cout << desc << ": std::sort " << throughput(data.size(), stdTime)
+              << ", numeric " << throughput(data.size(), numericTime)
+              << ", lexicographic " << throughput(data.size(), lexicographicTime)
+              << " million numbers/s with " << numCores << " core(s)" << std::endl;
+}
+
+// count the allocations made by doSort on its own and by a whole sort
+// the first sort grows the arenas, so later sorts only allocate the buckets
+// of the top level, tasks and the output buffer
+void benchmarkAllocations(const std::vector<unsigned int> &data, const std::string &desc, unsigned int numCores) {
+    for (auto cores : {1U, numCores}) {
+        auto pool = std::make_shared<ThreadPool>(cores - 1);
+        for (auto run : {"first", "second"}) {
+            BucketSort b;
+            b.numbersToSort = data;
+            const auto before = allocationCount.load();
+            if (cores == 1) {
+                b.doSort(0);
+            } else {
+                b.pool = pool;
+                b.sort(cores);
+            }
+            std::cout << desc << ": " << (cores == 1 ? "doSort" : "sort") << " with " << cores
+                      << " core(s), " << run << " run: " << allocationCount - before << " allocations" << std::endl;
         }
+    }
+}
+
+// report how long each worker spent sorting, with and without pinning the
+// workers to numa nodes, so imbalance and remote memory effects show up
+void benchmarkThreads(const std::vector<unsigned int> &data, const std::string &desc, unsigned int numCores) {
+    for (auto pinned : {false, true}) {
+        BucketSort b;
         b.numbersToSort = data;
-        b.sort(numCores); // ensure the cache is fair for each test
+        b.pool = std::make_shared<ThreadPool>(numCores - 1);
+        b.pinThreads = pinned;
+        const bool placed = pinned && b.pool->pin();
+        b.pool->resetBusyTimes();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        b.sort(numCores);
+        auto elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        const auto times = b.pool->busyTimes();
+        std::chrono::nanoseconds total{0}, slowest{0};
+        std::cout << desc << ": " << (placed ? "pinned" : "unpinned") << " threads, "
+                  << throughput(data.size(), elapsed) << " million numbers/s, ms per thread:";
+        for (auto i = 0U; i < times.size(); ++i) {
+            std::cout << (i + 1 == times.size() ? " main " : " ")
+                      << std::chrono::duration<double, std::milli>(times[i]).count();
+            if (i + 1 < times.size()) {
+                total += times[i];
+                slowest = std::max(slowest, times[i]);
+            }
+        }
+        // the slowest worker compared to the average, 1 is perfectly balanced
+        const auto workers = times.size() - 1;
+        std::cout << ", imbalance " << (total.count() ? slowest.count() * workers / double(total.count()) : 1.0)
+                  << std::endl;
+        if (pinned && !placed) {
+            std::cout << desc << ": single numa node, so threads were not pinned" << std::endl;
+        }
+    }
+}
 
-        // potentially could do i *= 2, not ++i
-        for (auto currentCores = 1U; currentCores <= numCores; ++currentCores) {
-            std::cout << "Testing " << desc << " with " << currentCores << " core(s)" << std::endl;
-            results << desc << ',' << currentCores;
-            for (auto i = 0U; i < numreps; ++i) {
+// merge sorted shards (as if sorted by separate machines or threads) with
+// mergeShards, compared to concatenating them and sorting again
+void benchmarkMerge(const std::vector<unsigned int> &data, const std::string &desc, unsigned int numCores) {
+    const std::size_t numShards = 8;
+    std::vector<std::vector<unsigned int>> shards(numShards);
+    for (std::size_t s = 0; s < numShards; ++s) {
+        BucketSort b;
+        b.numbersToSort.assign(data.begin() + data.size() * s / numShards,
+                               data.begin() + data.size() * (s + 1) / numShards);
+        b.sort(numCores);
+        shards[s] = std::move(b.numbersToSort);
+    }
+
+    BucketSort merged;
+    auto start = std::chrono::high_resolution_clock::now();
+    merged.mergeShards(shards, numCores);
+    auto mergeTime = std::chrono::high_resolution_clock::now() - start;
+
+    BucketSort sorted;
+    start = std::chrono::high_resolution_clock::now();
+    for (const auto &shard : shards) {
+        sorted.numbersToSort.insert(sorted.numbersToSort.end(), shard.begin(), shard.end());
+    }
+    sorted.sort(numCores);
+    auto sortTime = std::chrono::high_resolution_clock::now() - start;
+    assert(merged.numbersToSort == sorted.numbersToSort);
+
+    std::cout << desc << ": " << numShards << " sorted shards, merge " << throughput(data.size(), mergeTime)
+              << ", concatenate and sort " << throughput(data.size(), sortTime)
+              << " million numbers/s with " << numCores << " core(s)" << std::endl;
+
+    // shards cut from the sorted numbers, which follow on from each other
+    for (std::size_t s = 0; s < numShards; ++s) {
+        shards[s].assign(sorted.numbersToSort.begin() + data.size() * s / numShards,
+                         sorted.numbersToSort.begin() + data.size() * (s + 1) / numShards);
+    }
+    BucketSort concatenated;
+    start = std::chrono::high_resolution_clock::now();
+    concatenated.mergeShards(shards, numCores);
+    mergeTime = std::chrono::high_resolution_clock::now() - start;
+    assert(concatenated.numbersToSort == sorted.numbersToSort);
+
+    std::cout << desc << ": " << numShards << " sorted shards that do not overlap, merge "
+              << throughput(data.size(), mergeTime) << " million numbers/s with " << numCores << " core(s)"
+              << std::endl;
+}
+
+// keep the first few numbers with partialSort, compared to sorting them all
+void benchmarkPartial(const std::vector<unsigned int> &data, const std::string &desc, unsigned int numCores) {
+    // the best of a few runs each, so that the comparison is not noise
+    const int runs = 3;
+    BucketSort full;
+    auto sortTime = std::chrono::high_resolution_clock::duration::max();
+    for (int run = 0; run < runs; ++run) {
+        full.numbersToSort = data;
+        auto start = std::chrono::high_resolution_clock::now();
+        full.sort(numCores);
+        sortTime = std::min(sortTime, std::chrono::high_resolution_clock::now() - start);
+    }
+
+    for (std::size_t count : {std::size_t(1000), data.size() / 100}) {
+        BucketSort partial;
+        auto partialTime = std::chrono::high_resolution_clock::duration::max();
+        for (int run = 0; run < runs; ++run) {
+            partial.numbersToSort = data;
+            auto start = std::chrono::high_resolution_clock::now();
+            partial.partialSort(count, numCores);
+            partialTime = std::min(partialTime, std::chrono::high_resolution_clock::now() - start);
+        }
+        assert(std::equal(partial.numbersToSort.begin(), partial.numbersToSort.end(), full.numbersToSort.begin()));
+
+        std::cout << desc << ": first " << count << " numbers, partial sort " << throughput(data.size(), partialTime)
+                  << ", full sort " << throughput(data.size(), sortTime)
+                  << " million numbers/s with " << numCores << " core(s), "
+                  // a partial sort should never take longer than sorting everything
+                  << double(partialTime.count()) / sortTime.count() << " of the full sort time" << std::endl;
+    }
+}
+
+// sort with each way of scattering the numbers into their buckets: directly,
+// through write combining buffers, and through buffers written out with
+// non-temporal stores
+void benchmarkScatter(const std::vector<unsigned int> &data, const std::string &desc, unsigned int numCores) {
+    const std::pair<BucketSort::Scatter, const char *> scatters[] = {
+        {BucketSort::Scatter::Direct, "direct"},
+        {BucketSort::Scatter::Buffered, "buffered"},
+        {BucketSort::Scatter::NonTemporal, "non-temporal"},
+    };
+    std::cout << desc << ": scatter";
+    for (const auto &scatter : scatters) {
+        BucketSort b;
+        b.scatter = scatter.first;
+        b.numbersToSort = data;
+        auto start = std::chrono::high_resolution_clock::now();
+        b.sort(numCores);
+        auto elapsed = std::chrono::high_resolution_clock::now() - start;
+        std::cout << ' ' << scatter.second << ' ' << throughput(data.size(), elapsed);
+    }
+    std::cout << " million numbers/s with " << numCores << " core(s)" << std::endl;
+}
+
+// push the numbers in chunks through a StreamingBucketSort, which sorts each
+// window while the next is filled, compared to filling and then sorting each
+// window in turn
+void benchmarkStreaming(const std::vector<unsigned int> &data, const std::string &desc, unsigned int numCores) {
+    const std::size_t chunkSize = 1 << 16;
+    const std::size_t windowSize = std::min(data.size(), std::size_t(1) << 20);
+
+    // a checksum that depends on the order, so both must give the same windows
+    unsigned long long streamedSum = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    {
+        StreamingBucketSort stream(windowSize, numCores, [&](const std::vector<unsigned int> &window) {
+            for (auto n : window) {
+                streamedSum = streamedSum * 31 + n;
+            }
+        });
+        for (std::size_t i = 0; i < data.size(); i += chunkSize) {
+            stream.push(data.data() + i, std::min(chunkSize, data.size() - i));
+        }
+        stream.finish();
+    }
+    auto streamTime = std::chrono::high_resolution_clock::now() - start;
+
+    unsigned long long sortedSum = 0;
+    start = std::chrono::high_resolution_clock::now();
+    BucketSort b;
+    for (std::size_t i = 0; i < data.size(); i += windowSize) {
+        b.numbersToSort.clear();
+        for (std::size_t j = i; j < std::min(i + windowSize, data.size()); j += chunkSize) {
+            b.numbersToSort.insert(b.numbersToSort.end(), data.begin() + j,
+                                   data.begin() + std::min({j + chunkSize, i + windowSize, data.size()}));
+        }
+        b.sort(numCores);
+        for (auto n : b.numbersToSort) {
+            sortedSum = sortedSum * 31 + n;
+        }
+    }
+    auto sortTime = std::chrono::high_resolution_clock::now() - start;
+    assert(streamedSum == sortedSum);
+
+    std::cout << desc << ": windows of " << windowSize << " in chunks of " << chunkSize << ", streamed "
+              << throughput(data.size(), streamTime) << ", filled then sorted " << throughput(data.size(), sortTime)
+              << " million numbers/s with " << numCores << " core(s)" << std::endl;
+}
+
+// sort many small batches, creating new threads for every batch (fresh) or
+// reusing the threads of one pool for every batch (shared)
+void benchmarkBatches(unsigned int numCores, std::size_t size) {
+    std::mt19937 mt(6771);
+    std::uniform_int_distribution<unsigned int> dist(1, std::numeric_limits<unsigned int>::max());
+
+    for (auto batchSize : {10000U, 100000U}) {
+        const auto numBatches = size / batchSize / 10;
+        std::vector<std::vector<unsigned int>> batches(numBatches);
+        for (auto &batch : batches) {
+            for (auto i = 0U; i < batchSize; ++i) {
+                batch.push_back(dist(mt));
+            }
+        }
+
+        auto pool = std::make_shared<ThreadPool>(numCores - 1);
+        for (auto shared : {false, true}) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (const auto &batch : batches) {
                 BucketSort b;
-                b.numbersToSort = data;
+                b.numbersToSort = batch;
+                if (shared) {
+                    b.pool = pool;
+                }
+                b.sort(numCores);
+            }
+            auto elapsed = std::chrono::high_resolution_clock::now() - start;
+            std::cout << "Many small batches: " << numBatches << " x " << batchSize
+                      << (shared ? " with a shared pool: " : " with fresh threads: ")
+                      << throughput(numBatches * batchSize, elapsed) << " million numbers/s" << std::endl;
+        }
+    }
+}
+
+// find the size from which sorting with numCores cores beats one core, and
+// compare it with the number of cores the auto mode picks for each size
+// (run the main benchmark with --cores 1,N,auto and several --sizes to plot it)
+void benchmarkCrossover(unsigned int numCores) {
+    std::mt19937 mt(2022);
+    std::shared_ptr<ThreadPool> pool;
+    std::size_t crossover = 0;
+    for (std::size_t size = 16; size <= (std::size_t(1) << 22); size *= 4) {
+        std::vector<unsigned int> data(size);
+        for (auto &n : data) {
+            n = mt();
+        }
 
+        // the median of a few runs of each, so one slow run does not decide it
+        auto median = [&](unsigned int cores) {
+            const unsigned int reps = 5;
+            std::vector<double> times;
+            for (auto i = 0U; i < reps; ++i) {
+                BucketSort b;
+                b.numbersToSort = data;
+                b.pool = pool;
                 auto start = std::chrono::high_resolution_clock::now();
-                b.sort(currentCores);
-                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::high_resolution_clock::now() - start
-                );
-                results << ',' << ms.count();
+                b.sort(cores);
+                times.push_back(std::chrono::duration<double, std::micro>(
+                    std::chrono::high_resolution_clock::now() - start).count());
+                pool = b.pool;
             }
-            results << std::endl;
+            std::sort(times.begin(), times.end());
+            return times[reps / 2];
+        };
+        const double one = median(1), many = median(numCores), chosen = median(BucketSort::autoCores);
+        if (crossover == 0 && many < one) {
+            crossover = size;
+        }
+        std::cout << "Crossover: " << size << " numbers, 1 core " << one << " us, " << numCores << " cores "
+                  << many << " us, auto (" << BucketSort::coresFor(size) << " cores) " << chosen << " us" << std::endl;
+    }
+    if (crossover) {
+        std::cout << "Crossover: " << numCores << " cores are faster than 1 from " << crossover << " numbers" << std::endl;
+    } else {
+        std::cout << "Crossover: " << numCores << " cores were never faster than 1" << std::endl;
+    }
+}
+
+// a named way of generating numbers to sort
+struct Dataset {
+    std::string name; // short name used on the command line and in the json
+    std::string desc;
+    std::function<unsigned int(std::mt19937 &, std::size_t)> generate; // the i-th number
+};
+
+std::vector<Dataset> allDatasets() {
+    std::uniform_int_distribution<unsigned int> dist(1, std::numeric_limits<unsigned int>::max());
+    // log-uniform numbers have Benford distributed leading digits (about 30% start with 1)
+    std::uniform_real_distribution<double> exponentdist(0, std::log10(std::numeric_limits<unsigned int>::max()));
+
+    return {
+        {"uniform", "Uniform random distribution", [=](std::mt19937 &mt, std::size_t) mutable { return dist(mt); }},
+        {"common", "Common value distribution", [=](std::mt19937 &mt, std::size_t) mutable { return (dist(mt) / 1000) * 1000; }},
+        {"benford", "Benford distribution", [=](std::mt19937 &mt, std::size_t) mutable {
+            return static_cast<unsigned int>(std::pow(10.0, exponentdist(mt)));
+        }},
+        {"single-digit", "Single leading digit", [=](std::mt19937 &mt, std::size_t) mutable {
+            return 1000000000U + dist(mt) % 1000000000U;
+        }},
+        {"few-distinct", "100 distinct values", [=](std::mt19937 &mt, std::size_t) mutable {
+            // the values are the same for every seed
+            static const auto values = [] {
+                std::mt19937 valueMt(100);
+                std::vector<unsigned int> v(100);
+                for (auto &n : v) {
+                    n = valueMt();
+                }
+                return v;
+            }();
+            return values[mt() % values.size()];
+        }},
+        {"one-heavy", "80% one value", [=](std::mt19937 &mt, std::size_t) mutable {
+            return (mt() % 100 < 80) ? 123456U : dist(mt);
+        }},
+        {"zeros", "All zeros", [](std::mt19937 &, std::size_t) { return 0U; }},
+        {"max", "All max int", [](std::mt19937 &, std::size_t) { return std::numeric_limits<unsigned int>::max(); }},
+        {"increasing", "Monotomically increasing", [](std::mt19937 &, std::size_t i) {
+            return static_cast<unsigned int>(i + 1);
+        }},
+        // numbers of the same length are in lexicographic order when they increase
+        {"nearly-sorted", "Sorted with 1% noise", [=](std::mt19937 &mt, std::size_t i) mutable {
+            return (mt() % 100 == 0) ? dist(mt) : 1000000000U + static_cast<unsigned int>(i % 3000000000U);
+        }},
+    };
+}
+
+// what to run, as given on the command line
+struct Options {
+    std::vector<std::string> datasets; // every dataset if empty
+    std::vector<std::size_t> sizes{totalNumbers};
+    std::vector<unsigned int> cores; // 1 up to the hardware concurrency if empty, 0 is auto
+    unsigned int reps = numreps;
+    unsigned int warmups = numwarmups;
+    unsigned int seed = 1;
+    std::string json = "results.json";
+    bool experiments = false; // also run the one-off comparisons
+};
+
+// split a comma separated list
+std::vector<std::string> splitList(const std::string &list) {
+    std::vector<std::string> items;
+    std::istringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
         }
     }
+    return items;
+}
+
+void usage(const char *program) {
+    std::cerr << "usage: " << program << " [options]\n"
+              << "  --datasets a,b,...  datasets to sort (default: all)\n"
+              << "  --sizes n,m,...     numbers in each dataset (default: " << totalNumbers << ")\n"
+              << "  --cores c,d,...     core counts to sort with, or auto (default: 1 to " << std::thread::hardware_concurrency() << ")\n"
+              << "  --reps n            timed runs per measurement (default: " << numreps << ")\n"
+              << "  --warmups n         untimed runs before them (default: " << numwarmups << ")\n"
+              << "  --seed n            seed for the random datasets (default: 1)\n"
+              << "  --json file         where to write the results (default: results.json)\n"
+              << "  --experiments       also run the digit, cutoff, order, allocation, merge, partial sort, streaming,\n"
+              << "                      scatter, thread and crossover comparisons\n"
+              << "datasets:";
+    for (const auto &dataset : allDatasets()) {
+        std::cerr << ' ' << dataset.name;
+    }
+    std::cerr << std::endl;
+}
+
+// parse the command line, returning false if it is not valid
+bool parseOptions(int argc, char *argv[], Options &options) {
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    try {
+        for (std::size_t i = 0; i < args.size(); ++i) {
+            const bool hasValue = i + 1 < args.size();
+            if (args[i] == "--experiments") {
+                options.experiments = true;
+            } else if (!hasValue) {
+                return false;
+            } else if (args[i] == "--datasets") {
+                options.datasets = splitList(args[++i]);
+            } else if (args[i] == "--sizes") {
+                options.sizes.clear();
+                for (const auto &size : splitList(args[++i])) {
+                    options.sizes.push_back(std::stoull(size));
+                }
+            } else if (args[i] == "--cores") {
+                options.cores.clear();
+                for (const auto &cores : splitList(args[++i])) {
+                    options.cores.push_back(cores == "auto" ? BucketSort::autoCores : std::stoul(cores));
+                }
+            } else if (args[i] == "--reps") {
+                options.reps = std::stoul(args[++i]);
+            } else if (args[i] == "--warmups") {
+                options.warmups = std::stoul(args[++i]);
+            } else if (args[i] == "--seed") {
+                options.seed = std::stoul(args[++i]);
+            } else if (args[i] == "--json") {
+                options.json = args[++i];
+            } else {
+                return false;
+            }
+        }
+    } catch (const std::logic_error &) {
+        return false; // not a number
+    }
+
+    const auto known = allDatasets();
+    for (const auto &name : options.datasets) {
+        if (std::none_of(known.begin(), known.end(), [&](const Dataset &d) { return d.name == name; })) {
+            std::cerr << "unknown dataset " << name << std::endl;
+            return false;
+        }
+    }
+    if (options.cores.empty()) {
+        for (auto c = 1U; c <= std::max(1U, std::thread::hardware_concurrency()); ++c) {
+            options.cores.push_back(c);
+        }
+    }
+    return options.reps > 0;
+}
+
+// forget the peak resident set size so far, so the next one can be measured
+void resetPeakRss() {
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+// the peak resident set size in KiB (0 if it is not known)
+unsigned long long peakRssKiB() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stoull(line.substr(6));
+        }
+    }
+    return 0;
+}
+
+// the timings of one (dataset, size, cores) measurement
+struct Measurement {
+    std::string dataset;
+    std::size_t size;
+    unsigned int cores;
+    std::vector<long long> samples; // nanoseconds, sorted
+    std::size_t allocations; // median allocations per sort
+    unsigned long long peakRss; // KiB
+    SortStats stats; // from the last run (empty unless built with STATS=1)
+
+    // the p-th percentile (nearest rank)
+    long long percentile(double p) const {
+        const auto rank = static_cast<std::size_t>(std::ceil(p / 100 * samples.size()));
+        return samples[std::max<std::size_t>(rank, 1) - 1];
+    }
+
+    double elementsPerSecond() const {
+        return size / (percentile(50) / 1e9);
+    }
+};
+
+// time sorting data with the given number of cores, after some warm-up runs
+Measurement measure(const std::vector<unsigned int> &data, const std::string &name, unsigned int cores,
+                    const Options &options) {
+    Measurement m{name, data.size(), cores, {}, 0, 0, {}};
+    std::vector<std::size_t> allocations;
+    std::shared_ptr<ThreadPool> pool; // kept between runs, as a long running program would
+
+    resetPeakRss();
+    for (auto i = 0U; i < options.warmups + options.reps; ++i) {
+        BucketSort b;
+        b.numbersToSort = data;
+        b.pool = pool;
+
+        const auto allocated = allocationCount.load();
+        const auto start = std::chrono::steady_clock::now();
+        m.stats = b.sort(cores);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        const auto allocs = allocationCount - allocated;
+        pool = b.pool;
+
+        if (i >= options.warmups) {
+            m.samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            allocations.push_back(allocs);
+        }
+    }
+    m.peakRss = peakRssKiB();
+
+    std::sort(m.samples.begin(), m.samples.end());
+    std::sort(allocations.begin(), allocations.end());
+    m.allocations = allocations[allocations.size() / 2];
+    return m;
+}
+
+// a list of numbers as a json array
+template <typename Container>
+std::string jsonArray(const Container &values) {
+    std::ostringstream out;
+    out << '[';
+    bool first = true;
+    for (const auto &v : values) {
+        out << (first ? "" : ", ") << v;
+        first = false;
+    }
+    out << ']';
+    return out.str();
+}
+
+// the stats of a sort as a json object
+std::string jsonStats(const SortStats &stats) {
+    std::ostringstream out;
+    out << "{\"presort_ns\": " << stats.presortNanos
+        << ", \"count_ns\": " << stats.countNanos
+        << ", \"scatter_ns\": " << stats.scatterNanos
+        << ", \"bucket_ns\": " << stats.bucketNanos
+        << ", \"numbers_per_thread\": " << jsonArray(stats.numbersPerThread)
+        << ", \"ranges_at_digit\": " << jsonArray(stats.rangesAtDigit)
+        << ", \"buckets_of_size_log2\": " << jsonArray(stats.bucketsOfSize)
+        << ", \"contended_locks\": " << stats.contendedLocks << "}";
+    return out.str();
+}
+
+// escape a string for json
+std::string quote(const std::string &s) {
+    std::string quoted = "\"";
+    for (auto c : s) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + '"';
+}
+
+void writeJson(const std::string &path, const Options &options, const std::vector<Measurement> &results) {
+    std::ofstream out(path);
+    out << "{\n"
+        << "  \"warmups\": " << options.warmups << ",\n"
+        << "  \"reps\": " << options.reps << ",\n"
+        << "  \"seed\": " << options.seed << ",\n"
+        << "  \"hardware_concurrency\": " << std::thread::hardware_concurrency() << ",\n"
+        << "  \"simd_level\": " << static_cast<int>(supportedSimdLevel()) << ",\n"
+        << "  \"results\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto &m = results[i];
+        out << (i ? "," : "") << "\n    {"
+            << "\"dataset\": " << quote(m.dataset)
+            << ", \"size\": " << m.size
+            << ", \"cores\": " << m.cores
+            << ", \"min_ns\": " << m.samples.front()
+            << ", \"median_ns\": " << m.percentile(50)
+            << ", \"p95_ns\": " << m.percentile(95)
+            << ", \"elements_per_second\": " << static_cast<long long>(m.elementsPerSecond())
+            << ", \"allocations\": " << m.allocations
+            << ", \"peak_rss_kib\": " << m.peakRss;
+        if (m.stats.enabled) {
+            out << ", \"stats\": " << jsonStats(m.stats);
+        }
+        out << ", \"samples_ns\": " << jsonArray(m.samples) << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // the experiments need a concrete core count, so auto is left out of it
+    // (with only auto, they use every core)
+    unsigned int numCores = 0;
+    for (auto cores : options.cores) {
+        if (cores != BucketSort::autoCores) {
+            numCores = std::max(numCores, cores);
+        }
+    }
+    if (numCores == 0) {
+        numCores = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    if (options.experiments && numCores > 1) {
+        benchmarkBatches(numCores, options.sizes.front());
+    }
+    if (options.experiments) {
+        benchmarkCrossover(numCores);
+    }
+
+    std::vector<Measurement> results;
+    for (const auto &dataset : allDatasets()) {
+        if (!options.datasets.empty() &&
+            std::find(options.datasets.begin(), options.datasets.end(), dataset.name) == options.datasets.end()) {
+            continue;
+        }
+        const auto &desc = dataset.desc;
+
+        for (auto size : options.sizes) {
+            // the same numbers for every build, so results can be compared
+            std::mt19937 mt(options.seed);
+            std::vector<unsigned int> data(size);
+            for (std::size_t i = 0; i < size; ++i) {
+                data[i] = dataset.generate(mt, i);
+            }
+
+            if (options.experiments) {
+                benchmarkDigits(data, desc);
+                sweepCutoff(data, desc, numCores);
+                benchmarkOrders(data, desc, numCores);
+                benchmarkAllocations(data, desc, numCores);
+                benchmarkMerge(data, desc, numCores);
+                benchmarkPartial(data, desc, numCores);
+                benchmarkStreaming(data, desc, numCores);
+                benchmarkScatter(data, desc, numCores);
+                if (numCores > 1) {
+                    benchmarkThreads(data, desc, numCores);
+                }
+            }
+
+            for (auto cores : options.cores) {
+                results.push_back(measure(data, dataset.name, cores, options));
+                const auto &m = results.back();
+                std::cout << desc << ", " << size << " numbers, "
+                          << (cores == BucketSort::autoCores ? "auto" : std::to_string(cores)) << " core(s): "
+                          << "median " << m.percentile(50) / 1e6 << " ms, p95 " << m.percentile(95) / 1e6
+                          << " ms, min " << m.samples.front() / 1e6 << " ms, "
+                          << m.elementsPerSecond() / 1e6 << " million numbers/s, "
+                          << m.allocations << " allocations, peak rss " << m.peakRss / 1024 << " MiB" << std::endl;
+            }
+        }
+    }
+
+    writeJson(options.json, options, results);
+    std::cout << "Results written to " << options.json << std::endl;
 }
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2017 Costa Paraskevopoulos.
+ * Command line driver for the External Parallel Bucket Sort.
+ *
+ * Generates files of random numbers, sorts them and checks the result, so
+ * files larger than memory can be tried out on tmpfs or disk:
+ *   ./externalSort generate file count [seed]
+ *   ./externalSort sort input output [cores] [memory MiB] [spill directory]
+ *   ./externalSort check input output
+ */
+
+#include <thread>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include "ExternalBucketSort.h"
+#include "Digits.h"
+
+//numbers read or written at a time
+static const std::size_t blockSize = 1 << 20;
+
+//write count random numbers to path
+static void generate(const std::string& path, unsigned long long count, unsigned int seed) {
+	std::ofstream out(path, std::ios::binary);
+	std::mt19937 mt(seed);
+	std::vector<unsigned int> block;
+	while (count > 0) {
+		block.resize(std::min<unsigned long long>(count, blockSize));
+		for (auto& n: block) {
+			n = mt();
+		}
+		out.write(reinterpret_cast<const char*>(block.data()),
+			block.size() * sizeof(unsigned int));
+		count -= block.size();
+	}
+	if (!out) throw std::runtime_error("could not write " + path);
+}
+
+//the number of numbers in a stream and a checksum that ignores their order
+struct Summary {
+	unsigned long long count = 0;
+	unsigned long long sum = 0;
+	unsigned long long squares = 0;
+};
+
+//summarise the numbers in path, calling fn on each block of them
+template <typename Fn>
+static Summary summarise(const std::string& path, Fn fn) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) throw std::runtime_error("could not read " + path);
+	Summary s;
+	std::vector<unsigned int> block(blockSize);
+	while (in) {
+		in.read(reinterpret_cast<char*>(block.data()), blockSize * sizeof(unsigned int));
+		block.resize(in.gcount() / sizeof(unsigned int));
+		for (auto n: block) {
+			s.sum += n;
+			s.squares += static_cast<unsigned long long>(n) * n;
+		}
+		s.count += block.size();
+		fn(block);
+		block.resize(blockSize);
+	}
+	return s;
+}
+
+//check that output is input in lexicographic order
+static bool check(const std::string& input, const std::string& output) {
+	const Summary before = summarise(input, [] (const std::vector<unsigned int>&) {});
+
+	bool sorted = true;
+	bool first = true;
+	unsigned int previous = 0;
+	const Summary after = summarise(output, [&] (const std::vector<unsigned int>& block) {
+		for (auto n: block) {
+			sorted = sorted && (first || !lexLess(n, previous));
+			previous = n;
+			first = false;
+		}
+	});
+
+	return sorted && before.count == after.count && before.sum == after.sum &&
+		before.squares == after.squares;
+}
+
+int main(int argc, char* argv[]) {
+	const std::vector<std::string> args(argv + 1, argv + argc);
+	try {
+		if (args.size() >= 3 && args[0] == "generate") {
+			const unsigned int seed = (args.size() > 3) ? std::stoul(args[3]) : 1;
+			generate(args[1], std::stoull(args[2]), seed);
+			return 0;
+		}
+
+		if (args.size() >= 3 && args[0] == "sort") {
+			ExternalBucketSort pbs;
+			pbs.inputPath = args[1];
+			pbs.outputPath = args[2];
+			unsigned int numCores = std::thread::hardware_concurrency();
+			if (args.size() > 3) numCores = std::stoul(args[3]);
+			if (args.size() > 4) pbs.memoryLimit = std::stoull(args[4]) << 20;
+			if (args.size() > 5) pbs.spillDirectory = args[5];
+
+			auto start = std::chrono::high_resolution_clock::now();
+			pbs.sort(numCores);
+			auto end = std::chrono::high_resolution_clock::now();
+			auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+			std::cout << "Total execution time: " << millis.count() << " milliseconds\n";
+			return 0;
+		}
+
+		if (args.size() == 3 && args[0] == "check") {
+			const bool correct = check(args[1], args[2]);
+			std::cout << (correct ? "Output is correct" : "Output is incorrect") << std::endl;
+			return correct ? 0 : 1;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	std::cerr << "usage: " << argv[0] << " generate file count [seed]\n"
+		"       " << argv[0] << " sort input output [cores] [memory MiB] [spill directory]\n"
+		"       " << argv[0] << " check input output" << std::endl;
+	return 2;
+}
@@ -1,54 +1,94 @@
 #!/usr/bin/python3
 
+# plot the median speed of each dataset against the number of cores, from
+# the results.json written by benchmark (or another file given on the
+# command line), with bars from the p95 time up to the fastest time
+# only the largest size of each dataset is plotted
+# for datasets measured at several sizes, the time per number is also plotted
+# against the size for each core count (0 is the auto mode), which shows
+# where using more cores starts to pay off
+
+import itertools
+import json
+import sys
+
 import matplotlib.pyplot as plt
 import matplotlib.patches as mpatches
 from collections import defaultdict
 
-from math import sqrt
+def speed(nitems, ns):
+    return (float(nitems) / 1000000) / (ns / 1e9)
 
-def timeToSpeed(ms):
-    s = float(ms) / 1000
-    return (float(nitems) / 1000000) / s
+path = sys.argv[1] if len(sys.argv) > 1 else 'results.json'
+with open(path) as f:
+    results = json.load(f)['results']
 
-means = defaultdict(lambda: [0])
-errors = defaultdict(lambda: [0])
-average = defaultdict(lambda: [0])
+largest = defaultdict(int)
+for r in results:
+    largest[r['dataset']] = max(largest[r['dataset']], r['size'])
 
-f = open('results.csv')
-nitems = int(f.readline())
+cores = defaultdict(list)
+medians = defaultdict(list)
+errors = defaultdict(lambda: ([], []))
+average = defaultdict(list)
 
-for line in f:
-    dataset, cores, *results = line.strip().split(',')
-    cores = int(cores)
-    results = list(map(timeToSpeed, results))
-    mean = float(sum(results)) / len(results)
-    deviation = sqrt(sum((mean - x)**2 for x in results) / len(results))
-    means[dataset].append(mean)
-    average[cores].append(mean)
-    errors[dataset].append(deviation)
+for r in sorted(results, key=lambda r: r['cores']):
+    dataset = r['dataset']
+    if r['size'] != largest[dataset] or r['cores'] == 0:
+        continue
+    median = speed(r['size'], r['median_ns'])
+    cores[dataset].append(r['cores'])
+    medians[dataset].append(median)
+    errors[dataset][0].append(median - speed(r['size'], r['p95_ns']))
+    errors[dataset][1].append(speed(r['size'], r['min_ns']) - median)
+    average[r['cores']].append(median)
 
 for core in sorted(average):
-    mean = float(sum(average[core])) / len(average[core])
-    deviation = sqrt(sum((mean - x) ** 2 for x in average[core]) / len(average[core]))
-    means['Average'].append(mean)
-    errors['Average'].append(0)
+    cores['Average'].append(core)
+    medians['Average'].append(sum(average[core]) / len(average[core]))
+    errors['Average'][0].append(0)
+    errors['Average'][1].append(0)
 
 fig = plt.figure(figsize=(20, 10))
 ax = plt.subplot(111)
 
-tests = sorted(means, key=lambda x: '' if x == 'Average' else x)
-colors = dict(zip(tests, 'bgrcmyk'))
+tests = sorted(medians, key=lambda x: '' if x == 'Average' else x)
+# tab10 has 10 colours, so they are reused once there are more series
+colors = dict(zip(tests, itertools.cycle(plt.cm.tab10.colors)))
 legend = []
 for key in tests:
     legend.append(mpatches.Patch(color=colors[key], label=key))
-    ax.errorbar(range(len(means[key])), means[key], yerr=errors[key], c=colors[key], linewidth=2)
-    plt.xlim(0, len(means[key]))
+    ax.errorbar(cores[key], medians[key], yerr=errors[key], c=colors[key], linewidth=2)
 
-plt.ylabel("Speed (millions/second)")
+plt.ylabel("Median speed (millions/second)")
 plt.xlabel("Cores")
 
 box = ax.get_position()
 ax.set_position([box.x0, box.y0, box.width * 0.8, box.height])
 ax.legend(loc='center left', bbox_to_anchor=(1, 0.5), handles=legend)
 plt.savefig('results.png')
+
+sizes = defaultdict(set)
+for r in results:
+    sizes[r['dataset']].add(r['size'])
+
+for dataset in sorted(d for d in sizes if len(sizes[d]) > 1):
+    lines = defaultdict(list)
+    for r in sorted(results, key=lambda r: r['size']):
+        if r['dataset'] == dataset:
+            lines[r['cores']].append((r['size'], r['median_ns'] / r['size']))
+
+    fig = plt.figure(figsize=(20, 10))
+    ax = plt.subplot(111)
+    for c in sorted(lines):
+        label = 'auto' if c == 0 else '%d core(s)' % c
+        ax.plot([x for x, _ in lines[c]], [y for _, y in lines[c]], label=label, linewidth=2,
+                linestyle='--' if c == 0 else '-')
+    ax.set_xscale('log')
+    plt.ylabel("Median time per number (ns)")
+    plt.xlabel("Numbers sorted")
+    plt.title("Crossover for " + dataset)
+    ax.legend()
+    plt.savefig('crossover-%s.png' % dataset)
+
 plt.show()
@@ -6,9 +6,48 @@
 #include <thread>
 #include <random>
 #include <chrono>
+#include <string>
+#include <limits>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <stdexcept>
+#include <system_error>
 #include "BucketSort.h"
+#include "GenericBucketSort.h"
+#include "KeyValueBucketSort.h"
+#include "ExternalBucketSort.h"
+#include "StreamingBucketSort.h"
+#include "ThreadPool.h"
+#include "Arena.h"
+
+//sort keys with the generic sort on several core counts and check that
+//the keys end up in the same order as their strings
+template <typename Key, typename ToString>
+bool testGeneric(const std::vector<Key>& keys, ToString toString) {
+	std::vector<std::string> expected;
+	for (const auto& key: keys) {
+		expected.push_back(toString(key));
+	}
+	std::sort(expected.begin(), expected.end());
+
+	for (unsigned int ncores: {0U, 1U, 2U, 4U, 16U}) {
+		GenericBucketSort<Key> pbs;
+		pbs.keysToSort = keys;
+		if (ncores == 0) {
+			pbs.simpleSort();
+		} else {
+			pbs.sort(ncores);
+		}
+		for (unsigned int i = 0; i < keys.size(); ++i) {
+			if (toString(pbs.keysToSort[i]) != expected[i]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
 
 int main() {
 	unsigned int numWrong = 0;
@@ -150,7 +189,826 @@ int main() {
 		}
 	}
 
-	//test 3 (speed test): with 8 cores (on wagner), single-threaded version
+	//test 3: ensure the output does not depend on the number of threads used
+	{
+		std::cout << std::endl << "Testing output correctness for fixed core counts:" << std::endl;
+
+		std::mt19937 mt(6771);
+		std::uniform_int_distribution<unsigned int>
+			dist(0, std::numeric_limits<unsigned int>::max());
+
+		//sizes smaller and larger than the number of threads
+		bool correct = true;
+		for (unsigned int totalNumbers: {0U, 3U, 17U, 5000U, 100000U}) {
+			BucketSort expected;
+			for (unsigned int i = 0; i < totalNumbers; ++i) {
+				expected.numbersToSort.push_back(dist(mt) >> (i % 32));
+			}
+			BucketSort actual = expected;
+			expected.simpleSort();
+
+			//check the single-threaded sort against sorting the numbers as strings
+			std::vector<std::string> strings;
+			for (const auto& n: actual.numbersToSort) {
+				strings.push_back(std::to_string(n));
+			}
+			std::sort(strings.begin(), strings.end());
+			for (unsigned int i = 0; i < totalNumbers; ++i) {
+				if (std::to_string(expected.numbersToSort[i]) != strings[i]) {
+					std::cout << "Single-threaded output is incorrect for " <<
+					totalNumbers << " numbers" << std::endl;
+					numWrong++;
+					correct = false;
+					break;
+				}
+			}
+
+			for (unsigned int ncores: {2U, 3U, 4U, 8U, 16U}) {
+				for (bool pinned: {false, true}) {
+					BucketSort pbs = actual;
+					pbs.pinThreads = pinned;
+					pbs.sort(ncores);
+					if (pbs.numbersToSort != expected.numbersToSort) {
+						std::cout << "Output is incorrect for " << totalNumbers <<
+						" numbers on " << ncores << " cores" <<
+						(pinned ? " with pinned threads" : "") << std::endl;
+						numWrong++;
+						correct = false;
+					}
+				}
+			}
+
+			std::vector<unsigned int> numeric = actual.numbersToSort;
+			std::sort(numeric.begin(), numeric.end());
+			for (unsigned int ncores: {1U, 2U, 4U, 16U}) {
+				BucketSort pbs = actual;
+				pbs.sort(ncores, BucketSort::Order::Numeric);
+				if (pbs.numbersToSort != numeric) {
+					std::cout << "Numeric output is incorrect for " << totalNumbers <<
+					" numbers on " << ncores << " cores" << std::endl;
+					numWrong++;
+					correct = false;
+				}
+			}
+
+			for (unsigned int ncores: {1U, 2U, 4U, 16U}) {
+				BucketSort pbs = actual;
+				pbs.inPlaceSort(ncores);
+				if (pbs.numbersToSort != expected.numbersToSort) {
+					std::cout << "In-place output is incorrect for " << totalNumbers <<
+					" numbers on " << ncores << " cores" << std::endl;
+					numWrong++;
+					correct = false;
+				}
+			}
+		}
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		}
+	}
+
+	//test 4: sort other key types in the same order as their strings
+	{
+		std::cout << std::endl << "Testing output correctness for other key types:" << std::endl;
+
+		std::mt19937_64 mt(6771);
+		const unsigned int totalNumbers = 100000;
+		std::vector<unsigned long long> ids;
+		std::vector<int> ints;
+		std::vector<long long> longs;
+		std::vector<std::string> strings;
+		for (unsigned int i = 0; i < totalNumbers; ++i) {
+			ids.push_back(mt() >> (i % 64));
+			ints.push_back(static_cast<int>(mt()) >> (i % 32));
+			longs.push_back(static_cast<long long>(mt()) >> (i % 64));
+
+			//short strings from a small alphabet, so many share a prefix
+			std::string s = "key";
+			for (unsigned int j = mt() % 10; j > 0; --j) {
+				s += "az\x01\xff"[mt() % 4];
+			}
+			strings.push_back(s);
+		}
+		std::vector<const char*> cstrings;
+		for (const auto& s: strings) {
+			cstrings.push_back(s.c_str());
+		}
+
+		auto toString = [] (const auto& n) { return std::to_string(n); };
+		auto identity = [] (const std::string& s) { return s; };
+		auto fromCString = [] (const char* s) { return std::string(s); };
+
+		bool correct = testGeneric(ids, toString) && testGeneric(ints, toString) &&
+			testGeneric(longs, toString) && testGeneric(strings, identity) &&
+			testGeneric(cstrings, fromCString);
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 5: sort keys with payloads, keeping equal keys in their original order
+	{
+		std::cout << std::endl << "Testing output correctness for keys with payloads:" << std::endl;
+
+		std::mt19937 mt(6771);
+		const unsigned int totalNumbers = 100000;
+
+		//few distinct keys, so the order of equal keys is checked
+		BucketSort expected;
+		for (unsigned int i = 0; i < totalNumbers; ++i) {
+			expected.numbersToSort.push_back(mt() % 5000 * 1000);
+		}
+		const auto keys = expected.numbersToSort;
+		expected.simpleSort();
+
+		bool correct = true;
+		for (unsigned int ncores: {1U, 2U, 4U, 16U}) {
+			KeyValueBucketSort<std::string> kv;
+			kv.keysToSort = keys;
+			std::vector<std::pair<unsigned int, unsigned int>> records;
+			for (unsigned int i = 0; i < totalNumbers; ++i) {
+				kv.payloads.push_back(std::to_string(keys[i]) + "#" + std::to_string(i));
+				records.emplace_back(keys[i], i);
+			}
+			kv.sort(ncores);
+			sortByKey(records, [] (const auto& r) { return r.first; }, ncores);
+
+			correct = correct && kv.keysToSort == expected.numbersToSort;
+			for (unsigned int i = 0; i < totalNumbers; ++i) {
+				//the payload and record must still belong with their key
+				correct = correct && records[i].first == expected.numbersToSort[i];
+				correct = correct && kv.payloads[i] == std::to_string(records[i].first) +
+					"#" + std::to_string(records[i].second);
+				if (i > 0 && records[i].first == records[i - 1].first) {
+					correct = correct && records[i].second > records[i - 1].second;
+				}
+			}
+		}
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 6: vectorised bucket classification matches the scalar bucketOf
+	{
+		std::cout << std::endl << "Testing vectorised digit classification:" << std::endl;
+
+		//random numbers of every length, plus the edges of each length
+		std::mt19937 mt(1011);
+		std::vector<unsigned int> numbers;
+		for (unsigned int i = 0; i < 100000; ++i) {
+			numbers.push_back(mt() >> (mt() % 32));
+		}
+		for (unsigned int e = 1; e < maxDigits; ++e) {
+			numbers.push_back(powersOfTen[e] - 1);
+			numbers.push_back(powersOfTen[e]);
+			numbers.push_back(powersOfTen[e] + 1);
+		}
+		numbers.push_back(0);
+		numbers.push_back(std::numeric_limits<unsigned int>::max());
+
+		bool correct = true;
+		std::vector<unsigned char> buckets(numbers.size());
+		const auto best = static_cast<int>(supportedSimdLevel());
+		for (int level = 0; level <= best; ++level) {
+			for (unsigned int k = 0; k <= maxDigits; ++k) {
+				bucketsOf(numbers.data(), numbers.size(), k, buckets.data(),
+					static_cast<SimdLevel>(level));
+				for (unsigned int i = 0; i < numbers.size(); ++i) {
+					correct = correct && buckets[i] == bucketOf(numbers[i], k);
+				}
+			}
+		}
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 7: sort a file larger than the memory limit through spill runs
+	{
+		std::cout << std::endl << "Testing output correctness for files:" << std::endl;
+
+		//many repeats and short numbers, so runs are split more than once
+		std::mt19937 mt(2012);
+		BucketSort expected;
+		for (unsigned int i = 0; i < 200000; ++i) {
+			expected.numbersToSort.push_back(mt() >> (mt() % 32));
+		}
+		for (unsigned int i = 0; i < 20000; ++i) {
+			expected.numbersToSort.push_back(1000000);
+			expected.numbersToSort.push_back(7);
+		}
+		const std::string input = "/tmp/sortTester.in";
+		const std::string output = "/tmp/sortTester.out";
+		{
+			std::ofstream file(input, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(expected.numbersToSort.data()),
+				expected.numbersToSort.size() * sizeof(unsigned int));
+		}
+		expected.simpleSort();
+
+		bool correct = true;
+		for (unsigned int ncores: {1U, 4U}) {
+			for (std::size_t memoryLimit: {std::size_t(1) << 30, std::size_t(4096)}) {
+				ExternalBucketSort pbs;
+				pbs.inputPath = input;
+				pbs.outputPath = output;
+				pbs.memoryLimit = memoryLimit;
+				pbs.sort(ncores);
+
+				std::ifstream file(output, std::ios::binary);
+				std::vector<unsigned int> sorted(expected.numbersToSort.size() + 1);
+				file.read(reinterpret_cast<char*>(sorted.data()),
+					sorted.size() * sizeof(unsigned int));
+				sorted.resize(file.gcount() / sizeof(unsigned int));
+				correct = correct && sorted == expected.numbersToSort;
+			}
+		}
+
+		//a file of one 10-digit number, larger than the memory limit, is
+		//copied out rather than loaded once its digits run out
+		{
+			const std::vector<unsigned int> same(20000, std::numeric_limits<unsigned int>::max());
+			{
+				std::ofstream file(input, std::ios::binary);
+				file.write(reinterpret_cast<const char*>(same.data()),
+					same.size() * sizeof(unsigned int));
+			}
+			ExternalBucketSort pbs;
+			pbs.inputPath = input;
+			pbs.outputPath = output;
+			pbs.memoryLimit = 4096;
+			pbs.sort(2);
+
+			std::ifstream file(output, std::ios::binary);
+			std::vector<unsigned int> sorted(same.size() + 1);
+			file.read(reinterpret_cast<char*>(sorted.data()), sorted.size() * sizeof(unsigned int));
+			sorted.resize(file.gcount() / sizeof(unsigned int));
+			correct = correct && sorted == same;
+		}
+		std::remove(input.c_str());
+		std::remove(output.c_str());
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 8: nearly sorted input, which is merged rather than bucketed
+	{
+		std::cout << std::endl << "Testing output correctness for nearly sorted input:" << std::endl;
+
+		std::mt19937 mt(1016);
+		const unsigned int totalNumbers = 100000;
+		std::vector<std::vector<unsigned int>> inputs(5);
+		for (unsigned int i = 0; i < totalNumbers; ++i) {
+			//sorted numerically, so in a run per length
+			inputs[0].push_back(i);
+			//sorted lexicographically with 1% noise
+			inputs[1].push_back(mt() % 100 == 0 ? mt() : 1000000000 + i);
+			//sorted lexicographically apart from a few very large numbers
+			inputs[2].push_back(i % 5000 == 0 ? 999999999 : 1000000000 + i);
+			//too many runs to merge, but few numbers out of place
+			inputs[3].push_back(i % 200 == 0 ? 1000000000 : 2000000000 + i);
+		}
+		//sorted apart from the last number
+		inputs[4] = inputs[1];
+		std::sort(inputs[4].begin(), inputs[4].end(), lexLess);
+		inputs[4].push_back(0);
+
+		bool correct = true;
+		for (const auto& input: inputs) {
+			BucketSort expected;
+			expected.numbersToSort = input;
+			expected.simpleSort();
+			for (unsigned int ncores: {1U, 2U, 4U}) {
+				BucketSort pbs;
+				pbs.numbersToSort = input;
+				pbs.sort(ncores);
+				correct = correct && pbs.numbersToSort == expected.numbersToSort;
+			}
+		}
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 9: merge sorted shards in the same order as simpleSort
+	{
+		std::cout << std::endl << "Testing output correctness for merging shards:" << std::endl;
+
+		std::mt19937 mt(1017);
+		bool correct = true;
+		for (unsigned int numShards: {0U, 1U, 2U, 5U, 16U}) {
+			//shards of very different sizes (some empty) with many repeats
+			std::vector<std::vector<unsigned int>> shards(numShards);
+			BucketSort expected;
+			for (auto& shard: shards) {
+				const unsigned int size = (mt() % 3 == 0) ? 0 : mt() % 20000;
+				for (unsigned int i = 0; i < size; ++i) {
+					shard.push_back((mt() % 2) ? mt() % 1000 : mt() >> (mt() % 32));
+				}
+				std::sort(shard.begin(), shard.end(), lexLess);
+				expected.numbersToSort.insert(expected.numbersToSort.end(),
+					shard.begin(), shard.end());
+			}
+			expected.simpleSort();
+
+			for (unsigned int ncores: {1U, 2U, 3U, 4U, 16U}) {
+				BucketSort pbs;
+				pbs.mergeShards(shards, ncores);
+				correct = correct && pbs.numbersToSort == expected.numbersToSort;
+			}
+		}
+
+		//shards that follow on from each other, with empty shards between
+		{
+			BucketSort expected;
+			for (unsigned int i = 0; i < 30000; ++i) {
+				expected.numbersToSort.push_back(mt() % 100000);
+			}
+			expected.simpleSort();
+			const auto& sortedNumbers = expected.numbersToSort;
+			std::vector<std::vector<unsigned int>> shards = {
+				{sortedNumbers.begin(), sortedNumbers.begin() + 10000}, {},
+				{sortedNumbers.begin() + 10000, sortedNumbers.begin() + 25000},
+				{sortedNumbers.begin() + 25000, sortedNumbers.end()}, {}
+			};
+			for (unsigned int ncores: {1U, 4U}) {
+				BucketSort pbs;
+				pbs.mergeShards(shards, ncores);
+				correct = correct && pbs.numbersToSort == sortedNumbers;
+			}
+		}
+
+		//shards that are out of order are rejected
+		bool threw = false;
+		try {
+			BucketSort pbs;
+			pbs.mergeShards({{1, 2, 3}, {9, 10}}, 2);
+		} catch (const std::invalid_argument&) {
+			threw = true;
+		}
+		correct = correct && threw;
+		for (unsigned int ncores: {3U, 8U}) {
+			std::vector<std::vector<unsigned int>> shards(4);
+			for (auto& shard: shards) {
+				for (unsigned int i = 0; i < 1000; ++i) {
+					shard.push_back(mt());
+				}
+			}
+			//the vector is left as it was, even if some parts were merged
+			threw = false;
+			BucketSort pbs;
+			pbs.numbersToSort = {5, 4, 3};
+			try {
+				pbs.mergeShards(shards, ncores);
+			} catch (const std::invalid_argument&) {
+				threw = true;
+			}
+			correct = correct && threw &&
+				pbs.numbersToSort == std::vector<unsigned int>({5, 4, 3});
+		}
+
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 10: the first count numbers match a full sort
+	{
+		std::cout << std::endl << "Testing output correctness for partial sorts:" << std::endl;
+
+		std::mt19937 mt(1018);
+		bool correct = true;
+		for (unsigned int size: {0U, 20U, 5000U, 200000U}) {
+			for (unsigned int spread: {10U, 100000U, 0U}) {
+				std::vector<unsigned int> numbers(size);
+				for (auto& n: numbers) {
+					n = spread ? mt() % spread : mt();
+				}
+				BucketSort expected;
+				expected.numbersToSort = numbers;
+				expected.simpleSort();
+
+				//every other pass is nearly sorted, with 1% of the numbers
+				//moved, so partial sorts take the presorted path
+				if (mt() % 2 == 0) {
+					numbers = expected.numbersToSort;
+					for (unsigned int i = 0; i < size / 100; ++i) {
+						numbers[mt() % size] = mt();
+					}
+					expected.numbersToSort = numbers;
+					expected.simpleSort();
+				}
+
+				for (unsigned int count: {0U, 1U, 7U, size / 3, size, size + 5}) {
+					for (unsigned int ncores: {1U, 2U, 4U, 16U}) {
+						BucketSort pbs;
+						pbs.numbersToSort = numbers;
+						pbs.partialSort(count, ncores);
+						const auto keep = std::min<std::size_t>(count, size);
+						correct = correct && std::equal(pbs.numbersToSort.begin(), pbs.numbersToSort.end(),
+							expected.numbersToSort.begin(), expected.numbersToSort.begin() + keep);
+					}
+				}
+			}
+		}
+
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 11: inputs with few distinct numbers, or one very common number
+	{
+		std::cout << std::endl << "Testing output correctness for duplicate heavy input:" << std::endl;
+
+		std::mt19937 mt(1020);
+		bool correct = true;
+		for (unsigned int size: {3000U, 200000U}) {
+			for (unsigned int distinct: {2U, 7U, 100U}) {
+				for (unsigned int heavyShare: {0U, 2U, 10U}) {
+					std::vector<unsigned int> values(distinct);
+					for (auto& v: values) {
+						v = mt() >> (mt() % 32);
+					}
+					BucketSort expected;
+					for (unsigned int i = 0; i < size; ++i) {
+						//heavyShare mixes one common number into random ones
+						expected.numbersToSort.push_back(heavyShare == 0 ? values[mt() % distinct] :
+							(mt() % heavyShare == 0) ? mt() : values[0]);
+					}
+					const auto numbers = expected.numbersToSort;
+					expected.simpleSort();
+
+					for (unsigned int ncores: {1U, 2U, 4U, 16U}) {
+						BucketSort pbs;
+						pbs.numbersToSort = numbers;
+						pbs.sort(ncores);
+						correct = correct && pbs.numbersToSort == expected.numbersToSort;
+					}
+				}
+			}
+		}
+
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 12: sorts run asynchronously on a shared pool, and can be cancelled
+	{
+		std::cout << std::endl << "Testing output correctness for asynchronous sorts:" << std::endl;
+
+		std::mt19937 mt(1021);
+		bool correct = true;
+		auto pool = std::make_shared<ThreadPool>(3);
+		for (unsigned int ncores: {1U, 2U, 4U}) {
+			//several sorts in flight at once on the same pool
+			std::vector<BucketSort> sorts(6);
+			std::vector<BucketSort> expected(sorts.size());
+			std::vector<std::future<void>> futures;
+			for (std::size_t i = 0; i < sorts.size(); ++i) {
+				const unsigned int size = mt() % 100000;
+				for (unsigned int j = 0; j < size; ++j) {
+					sorts[i].numbersToSort.push_back(mt() >> (mt() % 32));
+				}
+				expected[i].numbersToSort = sorts[i].numbersToSort;
+				expected[i].simpleSort();
+				sorts[i].pool = pool;
+				futures.push_back(sorts[i].sortAsync(ncores));
+			}
+			for (std::size_t i = 0; i < sorts.size(); ++i) {
+				futures[i].get();
+				correct = correct && sorts[i].numbersToSort == expected[i].numbersToSort;
+			}
+		}
+
+		//a cancelled sort either finishes or reports that it was cancelled,
+		//and keeps the same numbers either way
+		for (unsigned int ncores: {1U, 4U}) {
+			BucketSort pbs;
+			for (unsigned int j = 0; j < 1000000; ++j) {
+				pbs.numbersToSort.push_back(mt());
+			}
+			BucketSort expected;
+			expected.numbersToSort = pbs.numbersToSort;
+			expected.simpleSort();
+
+			pbs.pool = pool;
+			auto future = pbs.sortAsync(ncores);
+			pbs.cancel();
+			try {
+				future.get();
+			} catch (const std::system_error& e) {
+				correct = correct && e.code() == std::errc::operation_canceled;
+				pbs.simpleSort();
+			}
+			correct = correct && pbs.numbersToSort == expected.numbersToSort;
+		}
+
+		//a sort waiting on its own tasks never picks up another's queued
+		//asynchronous sort, even while the pool's only worker is busy
+		{
+			auto busyPool = std::make_shared<ThreadPool>(1);
+			std::promise<void> release;
+			std::shared_future<void> released = release.get_future().share();
+			busyPool->post([released] () { released.wait(); });
+
+			BucketSort queued;
+			queued.numbersToSort.assign(100000, 7);
+			queued.pool = busyPool;
+			auto future = queued.sortAsync(2);
+
+			BucketSort pbs;
+			for (unsigned int j = 0; j < 100000; ++j) {
+				pbs.numbersToSort.push_back(mt());
+			}
+			pbs.pool = busyPool;
+			pbs.sort(2);
+			correct = correct && future.wait_for(std::chrono::seconds(0)) == std::future_status::timeout;
+			release.set_value();
+			future.get();
+		}
+
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 13: the number of cores can be chosen from the size of the input
+	{
+		std::cout << std::endl << "Testing output correctness for automatic core counts:" << std::endl;
+
+		std::mt19937 mt(1022);
+		bool correct = true;
+		for (unsigned int size: {0U, 1U, 2U, 12U, 1000U, 100000U, 2000000U}) {
+			BucketSort pbs;
+			for (unsigned int i = 0; i < size; ++i) {
+				pbs.numbersToSort.push_back(mt() >> (mt() % 32));
+			}
+			BucketSort expected;
+			expected.numbersToSort = pbs.numbersToSort;
+			expected.simpleSort();
+			pbs.sort(BucketSort::autoCores);
+			correct = correct && pbs.numbersToSort == expected.numbersToSort;
+
+			//every other sort takes the automatic core count too
+			BucketSort inPlace;
+			inPlace.numbersToSort = expected.numbersToSort;
+			std::shuffle(inPlace.numbersToSort.begin(), inPlace.numbersToSort.end(), mt);
+			BucketSort partial;
+			partial.numbersToSort = inPlace.numbersToSort;
+			inPlace.inPlaceSort(BucketSort::autoCores);
+			partial.partialSort(size / 2, BucketSort::autoCores);
+			BucketSort merged;
+			merged.mergeShards({expected.numbersToSort, {}}, BucketSort::autoCores);
+			GenericBucketSort<unsigned int> generic;
+			generic.keysToSort = inPlace.numbersToSort;
+			generic.sort(BucketSort::autoCores);
+			correct = correct && inPlace.numbersToSort == expected.numbersToSort &&
+				std::equal(partial.numbersToSort.begin(), partial.numbersToSort.end(),
+					expected.numbersToSort.begin()) &&
+				merged.numbersToSort == expected.numbersToSort &&
+				generic.keysToSort == expected.numbersToSort;
+		}
+
+		//small inputs are sorted on the calling thread, and larger inputs
+		//never get fewer cores than smaller ones
+		unsigned int previous = 1;
+		correct = correct && BucketSort::coresFor(12) == 1;
+		for (std::size_t size = 1; size <= (1U << 30); size *= 2) {
+			const unsigned int cores = BucketSort::coresFor(size);
+			correct = correct && cores >= previous &&
+				cores <= std::max(1U, std::thread::hardware_concurrency());
+			previous = cores;
+		}
+
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 14: the stats returned by sort add up (make STATS=1 to fill them in)
+	{
+		std::cout << std::endl << "Testing sort stats:" << std::endl;
+
+		std::mt19937 mt(1023);
+		bool correct = true;
+		for (unsigned int ncores: {1U, 2U, 4U}) {
+			BucketSort pbs;
+			for (unsigned int i = 0; i < 300000; ++i) {
+				pbs.numbersToSort.push_back(mt() >> (mt() % 32));
+			}
+			const std::size_t size = pbs.numbersToSort.size();
+			const SortStats stats = pbs.sort(ncores);
+
+			std::size_t moved = 0, ranges = 0, buckets = 0;
+			for (auto n: stats.numbersPerThread) moved += n;
+			for (auto n: stats.rangesAtDigit) ranges += n;
+			for (auto n: stats.bucketsOfSize) buckets += n;
+			if (stats.enabled) {
+				//every number is moved at least once, and each thread of the
+				//pool (plus the caller) has its own count
+				correct = correct && moved >= size && ranges > 0 && buckets > 0 &&
+					stats.numbersPerThread.size() == (ncores == 1 ? 1 : pbs.pool->size() + 1) &&
+					stats.bucketNanos > 0;
+			} else {
+				correct = correct && moved == 0 && ranges == 0 && buckets == 0 &&
+					stats.numbersPerThread.empty() && stats.bucketNanos == 0;
+			}
+		}
+		std::cout << "Stats are " << (statsEnabled ? "enabled" : "disabled") << std::endl;
+
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 15: streamed numbers come out as their windows, each sorted
+	{
+		std::cout << std::endl << "Testing streaming sorts:" << std::endl;
+
+		std::mt19937 mt(1024);
+		bool correct = true;
+		for (unsigned int ncores: {1U, 4U}) {
+			for (std::size_t windowSize: {1U, 1000U, 4096U}) {
+				std::vector<unsigned int> input;
+				for (unsigned int i = 0; i < 50000; ++i) {
+					input.push_back(mt() >> (mt() % 32));
+				}
+
+				//each window must be the next slice of the input, sorted
+				std::size_t next = 0;
+				StreamingBucketSort stream(windowSize, ncores,
+				[&] (const std::vector<unsigned int>& window) {
+					BucketSort expected;
+					const std::size_t end = std::min(next + windowSize, input.size());
+					expected.numbersToSort.assign(input.begin() + next, input.begin() + end);
+					expected.simpleSort();
+					correct = correct && window == expected.numbersToSort;
+					next = end;
+				});
+
+				//push chunks of random sizes, which cross the windows
+				for (std::size_t i = 0; i < input.size(); ) {
+					const std::size_t count = std::min<std::size_t>(mt() % 3000, input.size() - i);
+					stream.push(input.data() + i, count);
+					i += count;
+				}
+				stream.finish();
+				correct = correct && next == input.size();
+			}
+		}
+
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 16: scattering through write combining buffers gives the same order
+	{
+		std::cout << std::endl << "Testing buffered scatters:" << std::endl;
+
+		std::mt19937 mt(1025);
+		std::vector<unsigned int> input;
+		for (unsigned int i = 0; i < 400000; ++i) {
+			input.push_back(mt() >> (mt() % 32));
+		}
+		BucketSort expected;
+		expected.numbersToSort = input;
+		expected.simpleSort();
+
+		bool correct = true;
+		for (auto scatter: {BucketSort::Scatter::Buffered, BucketSort::Scatter::NonTemporal}) {
+			for (unsigned int ncores: {1U, 4U}) {
+				BucketSort pbs;
+				pbs.scatter = scatter;
+				pbs.numbersToSort = input;
+				pbs.sort(ncores);
+				correct = correct && pbs.numbersToSort == expected.numbersToSort;
+			}
+		}
+
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 17: nested arena scopes give back only their own memory
+	{
+		std::cout << std::endl << "Testing nested arena scopes:" << std::endl;
+
+		bool correct = true;
+		Arena arena;
+		{
+			Arena::Scope outer(arena);
+			unsigned int* kept = arena.allocate<unsigned int>(16);
+			std::fill(kept, kept + 16, 42U);
+
+			//outgrow the first block, leaving it retired but still in use
+			{
+				Arena::Scope grow(arena);
+				arena.allocate<unsigned int>(1000);
+			}
+
+			//two scopes starting at the same (empty) block, the inner of
+			//which grows the arena again, as when a thread waiting on a
+			//bucket runs another bucket's task
+			{
+				Arena::Scope first(arena);
+				{
+					Arena::Scope second(arena);
+					std::fill_n(arena.allocate<unsigned int>(100000), 100000, 7U);
+				}
+				std::fill_n(arena.allocate<unsigned int>(10), 10, 7U);
+			}
+			correct = std::all_of(kept, kept + 16, [] (unsigned int n) { return n == 42; });
+		}
+
+		//a block past the retained limit is freed once no scope is using it,
+		//and the arena starts again from a new one
+		for (std::size_t n: {Arena::retainedBytes, std::size_t(100)}) {
+			Arena::Scope scope(arena);
+			unsigned int* numbers = arena.allocate<unsigned int>(n);
+			std::fill_n(numbers, n, 7U);
+			correct = correct && numbers[n - 1] == 7;
+		}
+
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 18: tasks placed on a worker only run on that worker
+	{
+		std::cout << std::endl << "Testing tasks placed on workers:" << std::endl;
+
+		ThreadPool pool(4);
+		std::atomic<unsigned int> misplaced{0};
+		for (unsigned int round = 0; round < 100; ++round) {
+			TaskGroup group;
+			for (unsigned int w = 0; w < 8; ++w) {
+				pool.submitTo(w % 4, group, [&pool, &misplaced, w] () {
+					if (pool.currentIndex() != w % 4) ++misplaced;
+				});
+			}
+			//the caller waits (and helps) meanwhile, but must leave them
+			pool.wait(group);
+		}
+		bool correct = misplaced == 0;
+
+		if (correct) {
+			std::cout << "Output is correct" << std::endl;
+		} else {
+			std::cout << "Output is incorrect" << std::endl;
+			numWrong++;
+		}
+	}
+
+	//test 19 (speed test): with 8 cores (on wagner), single-threaded version
 	//takes 23 seconds and multi-threaded version takes 6 seconds
 	{
 		const unsigned int totalNumbers = 500000;